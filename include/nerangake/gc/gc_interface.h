@@ -18,6 +18,20 @@ public:
     virtual HeapObject **Pop() = 0;
     virtual void WriteBarrier(HeapObject *, RawObject **, HeapObject *) = 0;
 
+    /**
+     * Batched write barrier for bulk stores: `count` fields starting at
+     * `fields` of the object have already been written, record them at once
+     * if any of them needs it.
+     */
+    virtual void WriteBarrierRange(HeapObject *, RawObject **, size_t) = 0;
+
+    /**
+     * Pre-write barrier, only called while concurrent marking is on (see
+     * `HeapObject::set_concurrent_marking`): `count` fields starting at
+     * `fields` of the object are about to be overwritten.
+     */
+    virtual void PreWriteBarrier(HeapObject *, RawObject **, size_t) = 0;
+
 protected:
     GCInterface() = default;
 };
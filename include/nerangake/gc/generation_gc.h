@@ -1,10 +1,14 @@
 #pragma once
 
-#include <set>
-#include <stack>
-#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <nerangake/gc/gc_interface.h>
+#include <nerangake/gc/work_stealing_deque.h>
 #include <nerangake/memory/allocator_interface.h>
 #include <nerangake/memory/root_object_holder_interface.h>
 
@@ -13,13 +17,19 @@ namespace gc {
 
 class GenerationGC : public nrk::memory::AllocatorInterface,
                      public GCInterface {
-    using ForwardingMap = std::unordered_map<HeapObject *, HeapObject *>;
-
     GenerationGC(const GenerationGC &) = delete;
     GenerationGC &operator=(const GenerationGC &) = delete;
 
 public:
-    GenerationGC(size_t size);
+    /**
+     * @param num_of_workers    threads of minor GC, it scavenges in parallel
+     *                          if more than one.
+     * @param slice_budget_ms   if positive, old space is marked and swept in
+     *                          slices of about this long between allocations,
+     *                          instead of on a thread, see `RunSlice`.
+     */
+    GenerationGC(
+        size_t size, size_t num_of_workers = 1, double slice_budget_ms = 0.0);
     virtual ~GenerationGC();
 
     virtual void *Allocate(size_t size) override {
@@ -27,14 +37,16 @@ public:
     }
 
     virtual void *Static(size_t size) override {
-        return AllocateInOldSpace(size);
+        return AllocateStatic(size);
     }
 
-    virtual void Push(HeapObject **obj) override { temp_stack_.push(obj); }
+    virtual void Push(HeapObject **obj) override {
+        temp_stack_.push_back(obj);
+    }
 
     virtual HeapObject **Pop() override {
-        HeapObject **obj = temp_stack_.top();
-        temp_stack_.pop();
+        HeapObject **obj = temp_stack_.back();
+        temp_stack_.pop_back();
         return obj;
     }
 
@@ -43,26 +55,265 @@ public:
     virtual void FullGC() override;
     virtual void WriteBarrier(
         HeapObject *, RawObject **, HeapObject *) override;
+    virtual void WriteBarrierRange(
+        HeapObject *, RawObject **, size_t) override;
+    virtual void PreWriteBarrier(HeapObject *, RawObject **, size_t) override;
 
 private:
     void AllocationFail();
     void ProcessRootObjects(const RootObjectHolderInterface::Callback &cb);
 
-    HeapObject *Mark(HeapObject *obj);
-    void RecordForwarding(ForwardingMap &map);
-    void ResetReferences(ForwardingMap &map);
-    void Compact(ForwardingMap &map);
-    uint8_t *AllocateInOldSpace(size_t size);
+    bool ShouldStartMarking() const;
+    void StartMarking();
+    void ConcurrentMark(std::vector<HeapObject *> stack);
+    void FinishMajorGC();
+    void Shade(HeapObject *obj);
+    void FlushSatbBuffer();
+
+    void RunSlice();
+    size_t MarkSlice(std::chrono::steady_clock::time_point deadline);
+    size_t SweepSlice(std::chrono::steady_clock::time_point deadline);
+    void ScheduleSlice();
+
+    // The marker and mutator may mark the same word at the same time.
+    bool MarkObject(HeapObject *obj) {
+        size_t bit = MarkBitOf(obj);
+        uint64_t *word = &mark_bits_[marking_epoch_ & 1][bit >> 6];
+        uint64_t mask = static_cast<uint64_t>(1) << (bit & 63);
+        if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask) return false;
+        if (__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask)
+            return false;
+        MarkLines(obj);
+        return true;
+    }
+
+    bool IsMarked(const HeapObject *obj, uint8_t epoch) const {
+        size_t bit = MarkBitOf(obj);
+        const uint64_t *word = &mark_bits_[epoch & 1][bit >> 6];
+        return (__atomic_load_n(word, __ATOMIC_RELAXED) >> (bit & 63)) & 0x1;
+    }
+
+    void MarkLines(HeapObject *obj) {
+        uint8_t *start = reinterpret_cast<uint8_t *>(obj);
+        size_t last = LineOf(start + obj->size() - 1);
+        for (size_t line = LineOf(start); line <= last; ++line) {
+            __atomic_store_n(
+                &line_marks_[line], marking_epoch_, __ATOMIC_RELAXED);
+        }
+    }
+
+    // A line is free if no object in it was alive at the last major GC,
+    // nor has been marked since.
+    bool IsFreeLine(size_t line) const {
+        uint8_t mark = __atomic_load_n(&line_marks_[line], __ATOMIC_RELAXED);
+        return mark != live_epoch_ && mark != marking_epoch_;
+    }
+
+    template <typename Visit>
+    void VisitMarkedObjects(
+        size_t first_block, size_t last_block, uint8_t epoch, Visit &&visit);
+
+    HeapObject *ObjectCovering(uint8_t *address);
+    bool SelectEvacuationCandidates();
+    void EvacuateCandidates();
+    void ResetBlocks();
+    void NoteBlockStates();
+    void SweepBlock(size_t block);
+    void FormatFree(uint8_t *start, uint8_t *end);
+
+    // A bump allocation region of old space, a run of free lines within a
+    // block taken by its allocator.
+    struct Hole {
+        uint8_t *top = nullptr;
+        uint8_t *end = nullptr;
+        // Further holes of the block are found from line marks.
+        uint8_t *block_end = nullptr;
+    };
+
+    uint8_t *AllocateInOldSpace(size_t size) {
+        return AllocateInOldSpace(&hole_, size);
+    }
+
+    uint8_t *AllocateInOldSpace(Hole *hole, size_t size);
+    uint8_t *BumpHole(Hole *hole, size_t size);
+    bool NextHole(Hole *hole);
+    bool TakeFreeBlock(Hole *hole);
+    uint8_t *AllocateLarge(size_t size);
+    void TakeBlock(size_t block);
+    void NoteCardObjects(HeapObject *obj, uint8_t *end);
+    uint8_t *AllocateStatic(size_t size);
+    void ResetHoles();
+
+    HeapObject *ForwardEvacuated(HeapObject *obj) const {
+        if (IsYoung(obj) || BlockOf(obj) >= num_of_blocks_) return obj;
+        if (block_states_[BlockOf(obj)] != EVACUATING_BLOCK) return obj;
+        if (!obj->forwarded()) return obj;
+        return reinterpret_cast<HeapObject *>(obj->forwarding());
+    }
+
+    bool IsYoung(const HeapObject *obj) const {
+        return reinterpret_cast<const uint8_t *>(obj) < old_start_;
+    }
+
+    uint8_t *to_end() const {
+        return to_ == survivor1_start_ ? survivor2_start_ : old_start_;
+    }
+
+    // Old space a minor GC may need, if it promotes every survivor.
+    size_t young_size() const {
+        return (survivor1_start_ - start_) + (to_end() - to_);
+    }
+
+    HeapObject *Promote(HeapObject *obj, bool copy_out);
+    bool ReserveCopyOut(HeapObject *obj);
+    void ProcessTemporaryRoots();
+    void Scavenge();
+
+    template <typename Process>
+    void ProcessDirtyCards(Process &&process);
+
+    template <typename Copy>
+    bool ScanOldObject(HeapObject *obj, Copy &copy);
+
+    // A thread of parallel scavenge.
+    struct Worker {
+        // Objects to scan, copies and promoted or dirty old objects.
+        WorkStealingDeque<HeapObject *> deque;
+        // Its local allocation buffer in to space.
+        uint8_t *lab_top = nullptr;
+        uint8_t *lab_end = nullptr;
+        // Bytes it copied into to space, not yet added to `copy_out_room_`.
+        size_t copied = 0;
+        // Objects it promoted while marking is in progress.
+        std::vector<HeapObject *> promoted;
+        // Where it promotes small objects.
+        Hole promotion;
+    };
 
-    void Promote(HeapObject *obj);
-    void ProcessTransboundaryReference();
+    void ParallelScavenge();
+    void Work(size_t id, std::atomic<size_t> *active);
+    bool Steal(size_t id, HeapObject **obj);
+    bool HasWork() const;
+    HeapObject *ParallelCopy(Worker *worker, HeapObject *obj);
+    uint8_t *AllocateInToSpace(Worker *worker, size_t size);
+    uint8_t *BumpToSpace(size_t size);
 
+    bool ShouldCopyOut(HeapObject *obj) const;
+    size_t EvacuatedSize(HeapObject *obj, bool copy_out);
+    HeapObject *Evacuate(HeapObject *obj, uint8_t *address, bool copy_out);
     HeapObject *CopyIntoAnotherSpace(HeapObject *obj);
     // HeapObject *CopyAndSet(HeapObject **pObj);
     HeapObject *AllocateInNewSpace(size_t size);
 
+    bool ShouldCompact() const;
+    void Compact();
+    template <typename Task>
+    void ForEachChunk(size_t count, Task &&task);
+    void PlanChunk(size_t chunk);
+    void UpdateChunk(size_t chunk);
+    void MoveChunk(size_t chunk);
+    size_t LiveBytesInLine(size_t line, const uint8_t *limit) const;
+
+    HeapObject *CompactedAddress(HeapObject *obj) const {
+        if (IsYoung(obj) || BlockOf(obj) >= num_of_blocks_) return obj;
+        size_t line = LineOf(obj);
+        uint8_t *address =
+            old_start_ + (static_cast<size_t>(line_forwarding_[line]) << 3);
+        address += LiveBytesInLine(line, reinterpret_cast<uint8_t *>(obj));
+        return reinterpret_cast<HeapObject *>(address);
+    }
+
     static const uint8_t MAX_AGE = 64;
 
+    // Objects shaded by mutator are handed to the marker in batches.
+    static const size_t SATB_BUFFER_SIZE = 256;
+
+    // A mark slice checks its deadline every this many objects.
+    static const size_t SLICE_CHECK_INTERVAL = 64;
+    // Slices run at most this many times per eden, however far behind.
+    static const size_t MAX_SLICES_PER_EDEN = 64;
+    // Incremental marking starts early enough to finish at this many.
+    static const size_t PACED_SLICES_PER_EDEN = 16;
+
+    // Size of the local allocation buffers of parallel scavenge, larger
+    // objects are allocated from to space directly.
+    static const size_t LAB_SIZE = 32 * 1024;
+    // The first header byte of an object being copied by a worker, it is
+    // an impossible age with the forwarded bit set.
+    static const uint8_t BUSY_HEADER = 0xFF;
+
+    // Old space is split into cards of CARD_SIZE bytes, a card is dirty if
+    // a field within it may reference a young object.
+    static const size_t CARD_SHIFT = 9;
+    static const size_t CARD_SIZE = 1 << CARD_SHIFT;
+    enum CardState : uint8_t { CLEAN_CARD, DIRTY_CARD };
+
+    size_t CardOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - old_start_) >> CARD_SHIFT;
+    }
+
+    uint8_t *CardStart(size_t card) const {
+        return old_start_ + (card << CARD_SHIFT);
+    }
+
+    // Old space is also split into blocks of lines, Immix-style: it is
+    // marked by line and allocated by bumping into runs of free lines.
+    static const size_t LINE_SHIFT = 7;
+    static const size_t LINE_SIZE = 1 << LINE_SHIFT;
+    static const size_t BLOCK_SHIFT = 15;
+    static const size_t BLOCK_SIZE = 1 << BLOCK_SHIFT;
+    static const size_t LINES_PER_BLOCK = BLOCK_SIZE / LINE_SIZE;
+    // Objects from here on take whole blocks, others larger than a line are
+    // bumped into free blocks if they don't fit the current hole.
+    static const size_t LARGE_OBJECT_SIZE = BLOCK_SIZE / 4;
+    // Blocks with at most this many lines alive are evacuated.
+    static const size_t EVACUATION_THRESHOLD = LINES_PER_BLOCK / 4;
+    // One mark bit per word of old space.
+    static const size_t MARK_WORDS_PER_BLOCK = BLOCK_SIZE / 8 / 64;
+    // Compaction slides objects within chunks of this many blocks, each one
+    // compacted by a worker.
+    static const size_t BLOCKS_PER_CHUNK = 16;
+    enum BlockState : uint8_t {
+        FREE_BLOCK,
+        RECYCLABLE_BLOCK,
+        // Full, or taken by an allocator since the last major GC.
+        UNAVAILABLE_BLOCK,
+        EVACUATING_BLOCK,
+    };
+
+    size_t LineOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - old_start_) >> LINE_SHIFT;
+    }
+
+    uint8_t *LineStart(size_t line) const {
+        return old_start_ + (line << LINE_SHIFT);
+    }
+
+    size_t BlockOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - old_start_) >> BLOCK_SHIFT;
+    }
+
+    uint8_t *BlockStart(size_t block) const {
+        return old_start_ + (block << BLOCK_SHIFT);
+    }
+
+    size_t MarkBitOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - old_start_) >> 3;
+    }
+
+    size_t FreeLines(size_t block) const;
+
+    void DirtyCard(const void *address) {
+        // Workers of parallel scavenge may dirty a card at the same time.
+        __atomic_store_n(
+            &cards_[CardOf(address)], static_cast<uint8_t>(DIRTY_CARD),
+            __ATOMIC_RELAXED);
+    }
+
     const size_t space_size_;
     uint8_t *const start_;
     uint8_t *const survivor1_start_;
@@ -70,11 +321,95 @@ private:
     uint8_t *const old_start_;
     uint8_t *const end_;
 
-    std::set<HeapObject *> record_set_;
-    std::stack<HeapObject **> temp_stack_;
+    // The card table, one byte per card of old space.
+    std::vector<uint8_t> cards_;
+    // The object covering the first byte of each card, so that a dirty card
+    // is scanned without parsing old space from its start.
+    std::vector<HeapObject *> card_objects_;
+
+    // The epoch of the marking which last found each line alive, epochs
+    // count major GCs and skip 0, the mark of untouched lines.
+    std::vector<uint8_t> line_marks_;
+    uint8_t live_epoch_;
+    // Equals to `live_epoch_` unless marking is in progress.
+    uint8_t marking_epoch_;
+    // Mark bits of old objects, kept aside so that marking never writes to
+    // the objects. Markings use the two bitmaps in turn, by the parity of
+    // their epochs: the bits of the last one are read by lazy sweeping
+    // while the next one marks.
+    std::vector<uint64_t> mark_bits_[2];
+    std::vector<uint8_t> block_states_;
+    // Whether each block is swept since the last major GC, see `SweepBlock`.
+    std::vector<uint8_t> swept_;
+    // While compacting: where the objects marked in each line move to, in
+    // words from `old_start_`, and the object spanning into each chunk from
+    // the one before, if it stays alive.
+    std::vector<uint32_t> line_forwarding_;
+    std::vector<HeapObject *> chunk_heads_;
+    // Set by `FullGC`, see `ShouldCompact`.
+    bool compaction_requested_;
+    const size_t num_of_blocks_;
+    // Blocks before it are taken since the last major GC.
+    size_t next_block_;
+    // Bytes of free lines in blocks not taken yet.
+    size_t available_;
+    // Holes of mutator, `overflow_` is a free block for objects larger than
+    // a line. Workers take holes and large objects under `old_mutex_`.
+    Hole hole_;
+    Hole overflow_;
+    std::mutex old_mutex_;
+    std::vector<HeapObject **> temp_stack_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // Objects promoted during current scavenge, their children are scanned
+    // like the ones copied into to space.
+    std::vector<HeapObject *> promoted_;
+    // Old space beyond what current scavenge may still promote, which
+    // promoted slices grow into when copied out. Objects copied into to
+    // space are never promoted, their bytes are added as they are copied.
+    std::atomic<size_t> copy_out_room_;
+
+    // Major GC marks old space on `marker_` between the initial mark, at the
+    // end of a minor GC, and the remark of `FinishMajorGC`.
+    bool marking_;
+    // Marking starts once `available_` drops to here, half of what the last
+    // major GC left.
+    size_t marking_trigger_;
+    std::thread marker_;
+    std::atomic<bool> marker_done_;
+    // Gray objects shaded by mutator: overwritten by stores (SATB) or
+    // promoted. They are batched in `satb_buffer_`, then passed to the
+    // marker through `gray_queue_`.
+    std::mutex gray_mutex_;
+    std::vector<HeapObject *> gray_queue_;
+    std::vector<HeapObject *> satb_buffer_;
+    // Objects allocated in eden from here on aren't part of the snapshot.
+    uint8_t *eden_marking_start_;
+    // Young objects reached by the remark, noted by their forwarded bit.
+    std::vector<HeapObject *> young_live_;
+
+    // Incremental mode: the budget of a slice in nanoseconds, 0 if marking
+    // runs on `marker_`. Eden is allocated up to `slice_limit_` until the
+    // next slice.
+    const double slice_budget_;
+    uint8_t *slice_limit_;
+    // Gray objects of incremental marking, and the bytes scanned out of
+    // `mark_work_`, old space in use when it started and promoted since.
+    std::vector<HeapObject *> mark_stack_;
+    size_t marked_bytes_;
+    size_t mark_work_;
+    // Blocks before it are swept, or were when slices passed over them.
+    size_t sweep_cursor_;
+    // Pacing, see `ScheduleSlice`: bytes marked and swept per nanosecond,
+    // and bytes of old space promoted into per byte of eden.
+    double mark_rate_;
+    double sweep_rate_;
+    double promotion_rate_;
 
     uint8_t *from_, *to_, *to_free_;
-    uint8_t *new_free_, *old_free_;
+    uint8_t *new_free_;
+    // Old space is formatted up to here, blocks after it are untouched.
+    uint8_t *old_free_;
 };
 
 } // namespace gc
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <unordered_set>
+#include <vector>
+
+#include <nerangake/gc/gc_interface.h>
+#include <nerangake/memory/allocator_interface.h>
+#include <nerangake/memory/root_object_holder_interface.h>
+
+namespace nrk {
+namespace gc {
+
+/**
+ * RegionGC - a region-based collector in the style of G1, an alternative to
+ * `GenerationGC`.
+ *
+ * The heap is split into regions of equal size, each one free, young (eden
+ * or survivor), old or part of a humongous object. Every collection is a
+ * pause evacuating all young regions, and after a marking also the old
+ * regions which reclaim the most for their cost, as many as the pause target
+ * allows. Each region remembers the cards of other regions which may
+ * reference it, so that it is evacuated without scanning the rest.
+ */
+class RegionGC : public nrk::memory::AllocatorInterface,
+                 public GCInterface {
+    RegionGC(const RegionGC &) = delete;
+    RegionGC &operator=(const RegionGC &) = delete;
+
+public:
+    /**
+     * @param pause_target_ms   collections are sized to pause about this
+     *                          long, as predicted from the ones before.
+     */
+    RegionGC(size_t size, double pause_target_ms = 10.0);
+    virtual ~RegionGC();
+
+    virtual void *Allocate(memory::AllocateType type, size_t size) override;
+
+    virtual void Push(HeapObject **obj) override {
+        temp_stack_.push_back(obj);
+    }
+
+    virtual HeapObject **Pop() override {
+        HeapObject **obj = temp_stack_.back();
+        temp_stack_.pop_back();
+        return obj;
+    }
+
+    virtual void MajorGC() override;
+    virtual void MinorGC() override;
+    virtual void FullGC() override;
+    virtual void WriteBarrier(
+        HeapObject *, RawObject **, HeapObject *) override;
+    virtual void WriteBarrierRange(
+        HeapObject *, RawObject **, size_t) override;
+
+    // Marking stops the world, there is no snapshot to keep.
+    virtual void PreWriteBarrier(HeapObject *, RawObject **, size_t) override {
+    }
+
+private:
+    enum RegionType : uint8_t {
+        FREE_REGION,
+        EDEN_REGION,
+        SURVIVOR_REGION,
+        OLD_REGION,
+        // The first region of a humongous object, and the ones it spans.
+        HUMONGOUS_REGION,
+        HUMONGOUS_CONT_REGION,
+    };
+
+    struct Region {
+        RegionType type = FREE_REGION;
+        // Allocated from the region start up to here.
+        uint8_t *top = nullptr;
+        bool in_collection_set = false;
+        // Some of its objects stay, see `Evacuate`.
+        bool evacuation_failed = false;
+        // Bytes marked by the last marking.
+        size_t live_bytes = 0;
+        // Cards of other regions, objects starting in which may reference
+        // this one.
+        std::unordered_set<uint32_t> remembered_set;
+    };
+
+    void AllocationFail();
+    void ProcessRootObjects(
+        const memory::RootObjectHolderInterface::Callback &cb);
+
+    uint8_t *AllocateYoung(size_t size);
+    uint8_t *AllocateStatic(size_t size);
+    uint8_t *AllocateHumongous(size_t size);
+    uint8_t *TakeHumongousRegions(size_t size);
+    uint8_t *BumpRegion(size_t *alloc, RegionType type, size_t size);
+    size_t TakeFreeRegion(RegionType type);
+    void FreeRegion(size_t region);
+    bool CanGrowEden() const;
+    void NoteCardObjects(HeapObject *obj, uint8_t *end);
+
+    void RefineDirtyCards();
+    template <typename Visit>
+    void VisitCardObjects(uint32_t card, Visit &&visit);
+    bool RemembersFrom(size_t region) const;
+    void Remember(HeapObject *holder, HeapObject *target);
+
+    void Collect(bool all_candidates);
+    size_t ChooseCollectionSet(bool all_candidates);
+    HeapObject *Evacuate(HeapObject *obj);
+    void ScanObject(HeapObject *obj);
+    void RestoreFailedRegion(size_t region);
+    double PredictOldRegion(size_t region) const;
+    void UpdatePredictions(
+        double elapsed, double remembered_set_time, size_t young_bytes);
+
+    void Mark();
+    void Cleanup();
+    void ScrubRegion(size_t region);
+    size_t OldRegions() const;
+
+    bool MarkObject(HeapObject *obj) {
+        size_t bit = MarkBitOf(obj);
+        uint64_t mask = static_cast<uint64_t>(1) << (bit & 63);
+        if (mark_bits_[bit >> 6] & mask) return false;
+        mark_bits_[bit >> 6] |= mask;
+        regions_[RegionOf(obj)].live_bytes += obj->size();
+        return true;
+    }
+
+    bool IsMarked(const HeapObject *obj) const {
+        size_t bit = MarkBitOf(obj);
+        return (mark_bits_[bit >> 6] >> (bit & 63)) & 0x1;
+    }
+
+    void DirtyCard(const void *address) {
+        size_t card = CardOf(address);
+        if (cards_[card] != CLEAN_CARD) return;
+        cards_[card] = DIRTY_CARD;
+        dirty_cards_.push_back(static_cast<uint32_t>(card));
+    }
+
+    bool IsYoung(const HeapObject *obj) const {
+        RegionType type = regions_[RegionOf(obj)].type;
+        return type == EDEN_REGION || type == SURVIVOR_REGION;
+    }
+
+    size_t RegionOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - start_) >> REGION_SHIFT;
+    }
+
+    uint8_t *RegionStart(size_t region) const {
+        return start_ + (region << REGION_SHIFT);
+    }
+
+    size_t CardOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - start_) >> CARD_SHIFT;
+    }
+
+    uint8_t *CardStart(size_t card) const {
+        return start_ + (card << CARD_SHIFT);
+    }
+
+    size_t MarkBitOf(const void *address) const {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(address);
+        return static_cast<size_t>(p - start_) >> 3;
+    }
+
+    static const size_t REGION_SHIFT = 18;
+    static const size_t REGION_SIZE = 1 << REGION_SHIFT;
+    static const size_t NO_REGION = SIZE_MAX;
+    // Objects from here on take whole regions of their own, never moved.
+    static const size_t HUMONGOUS_SIZE = REGION_SIZE / 2;
+    static const size_t CARD_SHIFT = 9;
+    static const size_t CARD_SIZE = 1 << CARD_SHIFT;
+    // A dirty card is queued for refinement, a scanned one is skipped by the
+    // remembered sets of the other regions evacuated.
+    enum CardState : uint8_t { CLEAN_CARD, DIRTY_CARD, SCANNED_CARD };
+
+    // Survivors are promoted at this age.
+    static const uint8_t MAX_AGE = 15;
+    // The impossible age of an object failed to evacuate, forwarded to
+    // itself.
+    static const uint8_t SELF_FORWARDED_AGE = 127;
+    // Marking starts once old and humongous regions take this percentage of
+    // the heap.
+    static const size_t INITIATING_OCCUPANCY = 45;
+    // Old regions with more of their bytes alive, in percent, are left.
+    static const size_t MIXED_LIVE_THRESHOLD = 85;
+    // Candidates are all evacuated within this many mixed collections.
+    static const size_t MIXED_COLLECTIONS = 8;
+    // Eden is bounded in percent of regions, and leaves some free for
+    // survivors.
+    static const size_t MAX_EDEN_PERCENT = 60;
+    static const size_t RESERVE_PERCENT = 10;
+
+    const size_t space_size_;
+    uint8_t *const start_;
+    uint8_t *const end_;
+    const size_t num_of_regions_;
+    std::vector<Region> regions_;
+    std::vector<size_t> free_regions_;
+    // Regions being allocated into, or NO_REGION.
+    size_t eden_region_;
+    size_t survivor_region_;
+    size_t old_region_;
+    // Eden regions taken since the last collection, up to `young_target_`,
+    // and the survivor regions taken by it.
+    size_t eden_count_;
+    size_t survivor_count_;
+    size_t young_target_;
+
+    // The card table, one byte per card of the heap, and the object covering
+    // the first byte of each card of old and humongous regions.
+    std::vector<uint8_t> cards_;
+    std::vector<HeapObject *> card_objects_;
+    // Cards dirtied by the write barrier since the last collection, added to
+    // remembered sets when it starts.
+    std::vector<uint32_t> dirty_cards_;
+    std::vector<uint32_t> scanned_cards_;
+
+    std::vector<uint64_t> mark_bits_;
+    // Old regions worth evacuating since the last marking, the most
+    // efficient last, and how many a mixed collection takes at least.
+    std::vector<size_t> candidates_;
+    size_t mixed_min_;
+    // Old regions left by the last marking, see `MinorGC`.
+    size_t marked_occupancy_;
+
+    std::vector<HeapObject **> temp_stack_;
+    // Evacuated objects whose references aren't evacuated yet.
+    std::vector<HeapObject *> scan_stack_;
+
+    // Pause prediction, in nanoseconds: costs are averaged over the
+    // collections before, the survival rate is that of young bytes.
+    const double pause_target_;
+    double copy_cost_;
+    double card_cost_;
+    double survival_rate_;
+    size_t copied_bytes_;
+    size_t young_copied_bytes_;
+    size_t scanned_card_count_;
+};
+
+} // namespace gc
+} // namespace nrk
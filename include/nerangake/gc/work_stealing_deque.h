@@ -0,0 +1,146 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace nrk {
+namespace gc {
+
+/**
+ * WorkStealingDeque - the Chase-Lev deque, see "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (Le et al.).
+ *
+ * The owner thread pushes and pops at the bottom, other threads steal from
+ * the top. Buffers grow by doubling, retired ones are kept until the deque
+ * is destroyed, so that a thief never reads a freed buffer.
+ */
+template <typename T>
+class WorkStealingDeque {
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+public:
+    enum StealResult {
+        kStolen,
+        kEmpty,
+        // Lost a race with the owner or another thief, try again.
+        kAbort,
+    };
+
+    /**
+     * @param capacity  initial capacity, must be a power of two.
+     */
+    explicit WorkStealingDeque(size_t capacity = 1024) : top_(0), bottom_(0) {
+        assert((capacity & (capacity - 1)) == 0 && "power of two expected");
+
+        buffers_.emplace_back(new Buffer(capacity));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /**
+     * Push - owner only.
+     */
+    void Push(T value) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Buffer *buffer = buffer_.load(std::memory_order_relaxed);
+        if (b - t >= static_cast<int64_t>(buffer->capacity))
+            buffer = Grow(buffer, t, b);
+
+        buffer->Put(b, value);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    /**
+     * Pop - owner only.
+     *
+     * @return  false if the deque is empty.
+     */
+    bool Pop(T *value) {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Buffer *buffer = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *value = buffer->Get(b);
+        if (t < b) return true;
+
+        // The last one, thieves may race for it.
+        bool won = top_.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    StealResult Steal(T *value) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return kEmpty;
+
+        Buffer *buffer = buffer_.load(std::memory_order_acquire);
+        T stolen = buffer->Get(t);
+        if (!top_.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst,
+                std::memory_order_relaxed)) {
+            return kAbort;
+        }
+        *value = stolen;
+        return kStolen;
+    }
+
+private:
+    struct Buffer {
+        explicit Buffer(size_t capacity)
+            : capacity(capacity), slots(new std::atomic<T>[capacity]) {}
+
+        T Get(int64_t idx) const {
+            return slots[idx & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t idx, T value) {
+            slots[idx & (capacity - 1)].store(
+                value, std::memory_order_relaxed);
+        }
+
+        const size_t capacity;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    Buffer *Grow(Buffer *old, int64_t top, int64_t bottom) {
+        Buffer *buffer = new Buffer(old->capacity * 2);
+        for (int64_t i = top; i < bottom; ++i) buffer->Put(i, old->Get(i));
+        buffers_.emplace_back(buffer);
+        buffer_.store(buffer, std::memory_order_release);
+        return buffer;
+    }
+
+    std::atomic<int64_t> top_;
+    std::atomic<int64_t> bottom_;
+    std::atomic<Buffer *> buffer_;
+
+    // All buffers ever used, touched by the owner only.
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+} // namespace gc
+} // namespace nrk
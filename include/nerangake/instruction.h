@@ -22,6 +22,11 @@ public:
 
     static const uint8_t *Next(const uint8_t *pc, int32_t offset);
 
+    /**
+     * @return  number of instructions from `base` to `pc`.
+     */
+    static uint32_t Distance(const uint8_t *base, const uint8_t *pc);
+
 private:
     static uint16_t LittleEndianToLocal(uint16_t value);
     static uint32_t LittleEndianToLocal(uint32_t value);
@@ -24,7 +24,19 @@ public:
     Element Get(size_t idx);
     const Element Get(size_t idx) const;
 
-    void Children(const ForwardingCallback &cb);
+    /**
+     * Bulk stores, with one write barrier for the whole range.
+     *
+     * Move copies `count` elements from `src` starting at `begin` to this
+     * array at `at`, `src` may be this array and the ranges may overlap.
+     */
+    void Move(size_t at, const Array *src, size_t begin, size_t count);
+    void Fill(size_t begin, size_t end, Element obj);
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitArrayField<kBuffer>(visitor, GetFieldAs<uint32_t, kLength>());
+    }
 
 private:
     static void Init(Array *array, size_t length);
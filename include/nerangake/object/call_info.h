@@ -64,7 +64,10 @@ public:
     uint8_t end() const;
     uint8_t num_of_params() const;
 
-    void Children(const ForwardingCallback &cb);
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kCallee>(visitor);
+    }
 
 private:
     void set_is_light_func(bool);
@@ -34,7 +34,12 @@ public:
     const Element captured(unsigned idx) const;
     void set_captured(unsigned idx, Element e);
 
-    void Children(const ForwardingCallback &cb);
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kCallee>(visitor);
+        VisitArrayField<kCaptureds>(
+            visitor, GetFieldAs<uint16_t, kNumOfCaptures>());
+    }
 
 private:
     static void Init(
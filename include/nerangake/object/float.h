@@ -31,9 +31,10 @@ public:
     bool Inf() const;
     bool NaN() const;
 
+    double value() const;
+
 private:
     void set_value(double v);
-    double value() const;
 };
 
 static_assert(
@@ -1,67 +1,190 @@
 #pragma once
 
 #include <nerangake/object/array.h>
+#include <nerangake/object/heap_object.h>
+#include <nerangake/object/shape.h>
 
 namespace nrk {
 namespace object {
 
 /**
- * Object's model
- * - key    sizeof(RawObject*)
- * - value  sizeof(RawObject*)
- * - next   sizeof(RawObject*)
+ * HashTable is the open-addressing backing store of `HashMap`, in the style
+ * of Swiss table: a control byte per slot tells whether the slot is empty,
+ * deleted, or full (the low 7 bits of the hash), and control bytes are probed
+ * a group (16 slots) at a time. Keys and values live inline in `slots`, so
+ * neither inserting nor looking up allocates.
+ *
+ * Tables smaller than a group are small: there is no probing, the control
+ * bytes are matched all at once as a single word, erased slots become empty
+ * directly, and the table grows when it is full instead of at load factor.
+ *
+ * Object's model:
+ * - capacity (uint32_t)    power of two
+ * - size (uint32_t)        number of full slots
+ * - deleted (uint32_t)     number of tombstones
+ * - slots (RawObject[capacity * 2])    key, value pairs
+ * - control (uint8_t[capacity])
  */
-class HashNode : public HeapObject {
+class HashTable : public HeapObject {
 public:
-    enum HashNodeLayout {
-        kKey = kFieldStart,
-        kValue = kKey + sizeof(Element),
-        kNext = kValue + sizeof(Element),
+    enum HashTableLayout {
+        kCapacity = kFieldStart,
+        kSize = kCapacity + sizeof(uint32_t),
+        kDeleted = kSize + sizeof(uint32_t),
+        kSlots = kDeleted + sizeof(uintptr_t),
+    };
+
+    enum Control : uint8_t {
+        kEmpty = 0x80,   // 1000_0000
+        kTombstone = 0xFE, // 1111_1110
     };
 
-    IMPLICIT_CONSTRUCTORS(HashNode);
+    enum {
+        kGroupWidth = 16,
+        kNotFound = -1,
+    };
+
+    IMPLICIT_CONSTRUCTORS(HashTable);
+
+    static bool IsSmall(uint32_t capacity) { return capacity < kGroupWidth; }
+
+    static size_t Size(uint32_t capacity) {
+        return sizeof(uint32_t) * 2 + sizeof(uintptr_t) +
+            capacity * (sizeof(Element) * 2 + sizeof(uint8_t));
+    }
+
+    static HashTable *Create(uint32_t capacity);
+
+    uint32_t capacity() const { return GetFieldAs<uint32_t, kCapacity>(); }
+
+    uint32_t size() const { return GetFieldAs<uint32_t, kSize>(); }
+
+    uint32_t deleted() const { return GetFieldAs<uint32_t, kDeleted>(); }
+
+    bool IsFull(uint32_t slot) const { return (control()[slot] & kEmpty) == 0; }
+
+    bool IsSmall() const { return IsSmall(capacity()); }
 
-    static size_t Size() { return sizeof(Element) * 3; }
-    static HashNode *Create(const RawObject *key, Element value, Element next);
+    const Element key(uint32_t slot) const {
+        return GetArrayFieldAs<Element, kSlots>()[slot * 2];
+    }
+
+    Element value(uint32_t slot) {
+        return GetArrayFieldAs<Element, kSlots>()[slot * 2 + 1];
+    }
 
-    static HashNode *Create(RawObject *key, Element value) {
-        return Create(key, value, Nil::Create());
+    const Element value(uint32_t slot) const {
+        return GetArrayFieldAs<Element, kSlots>()[slot * 2 + 1];
     }
 
-    void set_key(const RawObject *key) { SetField<kKey>(key); }
+    void set_value(uint32_t slot, Element value) {
+        SetArrayField<kSlots>(slot * 2 + 1, value);
+    }
+
+    /**
+     * @return  the slot holding `key`, or kNotFound.
+     */
+    int32_t Lookup(const RawObject *key, uint32_t hash) const;
+
+    /**
+     * Insert `key` which must not exist, the table must have a free slot.
+     *
+     * @return  the slot holding `key`.
+     */
+    uint32_t Insert(const RawObject *key, uint32_t hash, Element value);
+
+    void Erase(uint32_t slot);
 
-    void set_value(Element value) { SetField<kValue>(value); }
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitArrayField<kSlots>(visitor, capacity() * 2);
+    }
 
-    void set_next(Element next) { SetField<kNext>(next); }
+private:
+    static void Init(HashTable *table, uint32_t capacity);
 
-    const Element key() const { return GetFieldAs<Element, kKey>(); }
+    uint8_t *control() {
+        return reinterpret_cast<uint8_t *>(
+            GetArrayFieldAs<Element, kSlots>() + capacity() * 2);
+    }
 
-    Element value() { return GetFieldAs<Element, kValue>(); }
+    const uint8_t *control() const {
+        return reinterpret_cast<const uint8_t *>(
+            GetArrayFieldAs<Element, kSlots>() + capacity() * 2);
+    }
 
-    const Element value() const { return GetFieldAs<Element, kValue>(); }
+    void set_capacity(uint32_t capacity) { SetField<kCapacity>(capacity); }
 
-    Element next() { return GetFieldAs<Element, kNext>(); }
+    void set_size(uint32_t size) { SetField<kSize>(size); }
 
-    void Children(const ForwardingCallback &cb);
+    void set_deleted(uint32_t deleted) { SetField<kDeleted>(deleted); }
+
+    void set_key(uint32_t slot, const RawObject *key) {
+        SetArrayField<kSlots>(slot * 2, const_cast<RawObject *>(key));
+    }
 };
 
 /**
+ * HashMap starts in shaped mode: while all keys are `ShortString`, the keys
+ * are described by a shared `Shape` and only values are stored, in `values`
+ * indexed by slot. Other keys, too many keys, or removing a key except the
+ * last added one switch the map to dictionary mode, backed by `HashTable`.
+ *
+ * Like Lua's table, Fixnum keys in [0, capacity of `array`) live in the array
+ * part, indexed directly, in either mode; other keys go to the hash part. The
+ * array part grows on dense appends, and is refitted to the integer keys
+ * whenever the hash part is going to expand, moving keys between the parts.
+ *
+ * In dictionary mode, HashMap resizes incrementally, in the style of Redis'
+ * dict: a resize only allocates the new table, then every following operation
+ * migrates at most `kMigrateSlots` slots from `old_table` until it is drained.
+ * During migration new keys go to `table`, and lookups consult both tables.
+ *
  * Object's model:
  * - loadfactor (float)
  * - size uint32_t
- * - Array (array)
+ * - migrated uint32_t      slots of old table already migrated
+ * - array_count uint32_t   number of keys in array part
+ * - HashTable (table)      Nil in shaped mode
+ * - HashTable (old_table)  Nil if not migrating
+ * - Shape (shape)          Nil in dictionary mode
+ * - Array (values)         Nil if no slot allocated
+ * - Array (array)          array part, Nil if empty
  */
 class HashMap : public HeapObject {
 public:
     enum HashMapOffset {
         kLoadFactor = kFieldStart,
         kLength = kLoadFactor + sizeof(double),
-        kBuckets = kLength + sizeof(uint32_t),
+        kMigrated = kLength + sizeof(uint32_t),
+        kArrayCount = kMigrated + sizeof(uint32_t),
+        kTable = kArrayCount + sizeof(uintptr_t),
+        kOldTable = kTable + sizeof(uintptr_t),
+        kShape = kOldTable + sizeof(uintptr_t),
+        kValues = kShape + sizeof(uintptr_t),
+        kArray = kValues + sizeof(uintptr_t),
+    };
+
+    enum {
+        // Small tables are scanned linearly, see `HashTable`.
+        kMinCapacity = 4,
+        kMigrateSlots = 64,
+        // Shrink only if less than 1/kShrinkRatio slots are used, so that
+        // the load after shrinking stays far from the expand threshold.
+        kShrinkRatio = 8,
+        kMinSlots = 4,
+        kMinArray = 4,
+        kMaxArrayBits = 20,
+        kMaxArray = 1 << kMaxArrayBits,
     };
 
     IMPLICIT_CONSTRUCTORS(HashMap);
 
-    static HashMap *Create();
+    /**
+     * Create a map presized for `narray` keys in [0, narray) and `nhash`
+     * other keys, like the size hints of Lua's table constructor.
+     */
+    static HashMap *Create(uint32_t narray = 0, uint32_t nhash = 0);
 
     uint32_t length() const { return GetFieldAs<uint32_t, kLength>(); }
 
@@ -71,42 +194,129 @@ public:
 
     double load_factor() const { return GetFieldAs<double, kLoadFactor>(); }
 
-    Array *buckets() { return GetFieldAs<Array *, kBuckets>(); }
+    HashTable *table() { return GetFieldAs<HashTable *, kTable>(); }
+
+    const HashTable *table() const { return GetFieldAs<HashTable *, kTable>(); }
+
+    void set_table(Element table) { SetField<kTable>(table); }
+
+    bool IsMigrating() const {
+        return !GetFieldAs<Element, kOldTable>()->IsNil();
+    }
+
+    bool IsShaped() const { return !GetFieldAs<Element, kShape>()->IsNil(); }
+
+    /**
+     * Shape identifies the key layout, Nil in dictionary mode. Maps of the
+     * same shape keep the same key in the same slot.
+     */
+    const Element shape() const { return GetFieldAs<Element, kShape>(); }
 
-    const Array *buckets() const { return GetFieldAs<Array *, kBuckets>(); }
+    /**
+     * @return  the slot of `key` in shaped mode, otherwise Shape::kNotFound.
+     */
+    int32_t SlotOf(const RawObject *key) const;
 
-    void set_buckets(Array *buckets) { SetField<kBuckets>(buckets); }
+    Element slot_value(uint32_t slot) { return values()->Get(slot); }
+
+    void set_slot_value(uint32_t slot, Element value) {
+        assert(!value->IsNil() && "remove key by `Remove`");
+        values()->Set(slot, value);
+    }
 
     void Set(const RawObject *key, Element value);
     Element Find(const RawObject *key);
     void Remove(const RawObject *key);
 
-    void Children(const ForwardingCallback &cb);
+    /**
+     * Find the first key at or after position `*cursor`, positions cover the
+     * array part, then the slots of the hash part. The cursor is advanced
+     * past the key found. Like Lua's `next`, keys added or removed during
+     * an iteration may be missed or seen twice, while updating values of
+     * existing keys is fine.
+     *
+     * @return  false if no key is left.
+     */
+    bool Next(uint32_t *cursor, Element *key, Element *value);
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kArray>(visitor);
+        if (IsShaped()) {
+            VisitField<kShape>(visitor);
+            VisitField<kValues>(visitor);
+            return;
+        }
+
+        VisitField<kTable>(visitor);
+        if (IsMigrating()) VisitField<kOldTable>(visitor);
+    }
 
 private:
     void set_length(uint32_t size) { SetField<kLength>(size); }
 
-    uint32_t capacity() const { return buckets()->length(); }
+    uint32_t migrated() const { return GetFieldAs<uint32_t, kMigrated>(); }
+
+    void set_migrated(uint32_t migrated) { SetField<kMigrated>(migrated); }
+
+    HashTable *old_table() { return GetFieldAs<HashTable *, kOldTable>(); }
+
+    void set_old_table(Element table) { SetField<kOldTable>(table); }
+
+    Shape *current_shape() { return GetFieldAs<Shape *, kShape>(); }
+
+    void set_shape(Element shape) { SetField<kShape>(shape); }
+
+    Array *values() { return GetFieldAs<Array *, kValues>(); }
+
+    uint32_t array_count() const { return GetFieldAs<uint32_t, kArrayCount>(); }
+
+    void set_array_count(uint32_t count) { SetField<kArrayCount>(count); }
+
+    uint32_t array_capacity() const {
+        const Element array = GetFieldAs<Element, kArray>();
+        return array->IsNil() ? 0 : Cast<Array>(From(array))->length();
+    }
+
+    Array *array() { return GetFieldAs<Array *, kArray>(); }
+
+    void set_array(Element array) { SetField<kArray>(array); }
+
+    // number of keys in hash part
+    uint32_t hash_length() const { return length() - array_count(); }
+
+    void set_values(Element values) { SetField<kValues>(values); }
+
+    uint32_t capacity() const { return table()->capacity(); }
 
     void ValidateKeyType(const RawObject *key);
-    void SetWithoutUpdate(const RawObject *obj, Element value);
+    bool SetShaped(const RawObject *key, Element value);
+    void ReserveSlots(uint32_t slots);
+    void ToDictionary();
+    bool ArrayIndex(const RawObject *key, uint32_t *idx) const;
+    bool ShouldGrowArray(const RawObject *key, uint32_t *capacity) const;
+    void StoreInArray(uint32_t idx, Element value);
+    void GrowArray(uint32_t capacity);
+    void ShrinkArray(uint32_t capacity);
+    void MoveToArray(HashTable *table, uint32_t begin);
+    uint32_t ComputeArraySize();
+    void Rebalance();
     void Update();
     void Expand();
     void Shrink();
     void Rehash(size_t capacity);
+    void Migrate(uint32_t slots);
+    size_t Threshold() const;
     bool IsNeedExpand();
     bool IsNeedShrink();
-
-    Element GetHashNodeLink(const RawObject *key);
-    void SetHashNodeLink(const RawObject *key, Element link);
 };
 
 static_assert(
-    std::is_trivially_copyable<HashNode>::value,
-    "class `HashNode` must be trivially copyable type.");
+    std::is_trivially_copyable<HashTable>::value,
+    "class `HashTable` must be trivially copyable type.");
 static_assert(
     std::is_trivially_copyable<HashMap>::value,
     "class `HashMap` must be trivially copyable type.");
 
 } // namespace object
-} // namespace nrk
\ No newline at end of file
+} // namespace nrk
@@ -16,7 +16,6 @@ typedef std::function<HeapObject *(HeapObject *)> ForwardingCallback;
 struct ObjectMethodTable {
     bool (*equals)(const HeapObject *, const HeapObject *);
     uint32_t (*hash_code)(const HeapObject *);
-    void (*process_children)(HeapObject *, const ForwardingCallback &);
 };
 
 /**
@@ -60,12 +59,22 @@ public:
         kClosure,
         kFloat,
         kHashMap,
-        kHashNode,
+        kHashTable,
         kPrototype,
         kStack,
         kString,
         kUserClosure,
-        kVector
+        kVector,
+        kRope,
+        kStringSlice,
+        kShape,
+        kPackedArray,
+        kTypedArray,
+        kSwitchTable,
+        kRecordDescriptor,
+        kRecord,
+        // Free space of old space, see `CreateFiller`.
+        kFiller
     };
 
     static HeapObject *From(RawObject *obj) { return obj->As<HeapObject>(); }
@@ -96,6 +105,12 @@ public:
 
     static uint32_t HashCode(const RawObject *obj);
     static bool Equals(const RawObject *key1, const RawObject *key2);
+
+    /**
+     * Children - `VisitPointers` with a type-erased callback, for callers
+     * which hold a `ForwardingCallback`. Collectors should pass their own
+     * visitor to `VisitPointers` (see object/visitor.h) to inline the walk.
+     */
     static void Children(HeapObject *obj, const ForwardingCallback &cb);
 
     IMPLICIT_CONSTRUCTORS(HeapObject);
@@ -119,6 +134,21 @@ public:
 
     bool forwarded() { return At<uint8_t, kForwarded>() & 0b0001; }
 
+    /**
+     * While GC marks concurrently, every store to a reference field reports
+     * the value it overwrites to GC, see `GCInterface::PreWriteBarrier`.
+     */
+    static void set_concurrent_marking(bool marking) {
+        concurrent_marking_ = marking;
+    }
+
+    /**
+     * Format `size` bytes at `address` as a dead object without references,
+     * so that a space with holes stays parsable object by object. `size` is
+     * at least one word.
+     */
+    static HeapObject *CreateFiller(void *address, size_t size);
+
     uint32_t size() {
         uint8_t high = At<uint8_t, kObjectSize>();
         uint16_t low = At<uint16_t, kObjectSize + 1>();
@@ -164,7 +194,16 @@ public:
     V(String)            \
     V(UserClosure)       \
     V(Vector)            \
-    V(HashNode)
+    V(HashTable)         \
+    V(Rope)              \
+    V(StringSlice)       \
+    V(Shape)             \
+    V(PackedArray)       \
+    V(TypedArray)        \
+    V(SwitchTable)       \
+    V(RecordDescriptor)  \
+    V(Record)            \
+    V(Filler)
 
     // is_xxx
     CHILDREN_LIST(IS_CHILD)
@@ -219,61 +258,105 @@ protected:
         return Index<Class, offset>();
     }
 
-    template <unsigned offset, typename Class>
+    // Stores of any pointer to object go through the write barrier below,
+    // whatever its static type is.
+    template <typename Class>
+    using IfNotObject = typename std::enable_if<
+        !std::is_convertible<Class, const RawObject *>::value>::type;
+
+    template <
+        unsigned offset, typename Class,
+        typename = IfNotObject<Class>>
     void SetField(Class val) {
         At<Class, offset>() = val;
     }
 
     template <unsigned offset>
-    void SetField(RawObject *obj) {
-        if (obj->IsObject())
+    void SetField(const RawObject *val) {
+        RawObject *obj = const_cast<RawObject *>(val);
+        if (obj->IsObject() || concurrent_marking_)
             // Write barrier are used.
-            SetFieldInteranl(
-                Index<RawObject *, offset>(), HeapObject::From(obj));
+            SetFieldInternal(Index<RawObject *, offset>(), obj);
         else
             At<RawObject *, offset>() = obj;
     }
 
-    template <unsigned offset, typename Class>
+    template <
+        unsigned offset, typename Class,
+        typename = IfNotObject<Class>>
     void SetArrayField(unsigned idx, Class val) {
         Index<Class, offset>()[idx] = val;
     }
 
     template <unsigned offset>
-    void SetArrayField(unsigned idx, RawObject *obj) {
-        if (obj->IsObject())
-			// Write barrier are used.
-            SetFieldInteranl(
-                &Index<RawObject *, offset>()[idx], HeapObject::From(obj));
+    void SetArrayField(unsigned idx, const RawObject *val) {
+        RawObject *obj = const_cast<RawObject *>(val);
+        if (obj->IsObject() || concurrent_marking_)
+            // Write barrier are used.
+            SetFieldInternal(&Index<RawObject *, offset>()[idx], obj);
         else
             Index<RawObject *, offset>()[idx] = obj;
     }
 
-    template <
-        typename Type,
-        typename = typename std::enable_if<
-            std::is_base_of<HeapObject, Type>::value, Type>::type>
-    Type *ForwardingObject(const ForwardingCallback &cb, HeapObject *obj) {
-        return HeapObject::Cast<Type>(cb(obj));
+    /**
+     * Pass the object referenced by `slot`, if any, to `visitor` and store
+     * back the returned one if it differs. Collectors move objects through it
+     * and track references themselves, so the write barrier is bypassed. A
+     * concurrent marker never writes, so it can't undo a store of mutator.
+     *
+     * The marker thread reads slots while mutator and minor GC store to
+     * them, so slots are accessed atomically, relaxed is enough since the
+     * barriers synchronize on their own.
+     */
+    template <typename Visitor>
+    static void VisitSlot(Visitor &visitor, RawObject **slot) {
+        RawObject *raw = __atomic_load_n(slot, __ATOMIC_RELAXED);
+        if (!raw->IsObject()) return;
+
+        RawObject *moved = visitor(From(raw));
+        if (moved != raw) __atomic_store_n(slot, moved, __ATOMIC_RELAXED);
     }
 
-    template <
-        typename Type,
-        typename = typename std::enable_if<
-            std::is_base_of<HeapObject, Type>::value, Type>::type>
-    const Type *ForwardingObject(
-        const ForwardingCallback &cb, const HeapObject *obj) {
-        HeapObject *nobj = const_cast<HeapObject *>(obj);
-        return ForwardingObject<Type>(cb, nobj);
+    template <unsigned offset, typename Visitor>
+    void VisitField(Visitor &visitor) {
+        VisitSlot(visitor, Index<RawObject *, offset>());
+    }
+
+    template <unsigned offset, typename Visitor>
+    void VisitArrayField(Visitor &visitor, size_t count) {
+        RawObject **slots = Index<RawObject *, offset>();
+        for (size_t i = 0; i < count; ++i) VisitSlot(visitor, &slots[i]);
     }
 
     void set_type(uint8_t type) { SetField<kType>(type); }
 
+    /**
+     * Write barrier of a bulk store, which has already written `count` fields
+     * starting at `fields`.
+     */
+    void WriteBarrierRange(RawObject **fields, size_t count);
+
+    /**
+     * Pre-write barrier of a bulk store, which is about to overwrite `count`
+     * fields starting at `fields`.
+     */
+    void PreWriteBarrierRange(RawObject **fields, size_t count);
+
+    /**
+     * Bulk stores of reference fields, barriers are left to the caller. While
+     * GC marks concurrently, fields are stored one by one atomically, see
+     * `VisitSlot`. `MoveSlots` allows overlapping ranges.
+     */
+    static void MoveSlots(RawObject **dst, RawObject *const *src, size_t count);
+    static void FillSlots(RawObject **dst, RawObject *obj, size_t count);
+
 private:
     HeapObject *AllocateDef(size_t size);
     HeapObject *StaticDef(size_t size);
 
-    void SetFieldInternal(RawObject **field, HeapObject *obj);
+    void SetFieldInternal(RawObject **field, RawObject *obj);
+
+    static bool concurrent_marking_;
 
     /**
      * At like `this->filed`.
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <nerangake/object/heap_object.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * PackedArray is an untraced buffer of unboxed 8-byte numbers, it holds no
+ * reference, so GC never scans it.
+ *
+ * Object's layout
+ * - length (uint32_t)
+ * - data (int64_t or double [length])
+ **/
+class PackedArray : public HeapObject {
+public:
+    enum PackedArrayLayout {
+        kLength = kFieldStart,
+        kData = kLength + sizeof(uintptr_t),
+    };
+
+    IMPLICIT_CONSTRUCTORS(PackedArray);
+
+    static size_t Size(uint32_t length) {
+        return sizeof(uintptr_t) + length * sizeof(int64_t);
+    }
+
+    static PackedArray *Create(uint32_t length);
+
+    uint32_t length() const { return GetFieldAs<uint32_t, kLength>(); }
+
+    int64_t *ints() { return GetArrayFieldAs<int64_t, kData>(); }
+
+    const int64_t *ints() const { return GetArrayFieldAs<int64_t, kData>(); }
+
+    double *doubles() { return GetArrayFieldAs<double, kData>(); }
+
+    const double *doubles() const { return GetArrayFieldAs<double, kData>(); }
+
+private:
+    void set_length(uint32_t length) { SetField<kLength>(length); }
+};
+
+static_assert(
+    std::is_trivially_copyable<PackedArray>::value,
+    "class `PackedArray` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
@@ -2,7 +2,8 @@
 
 #include <vector>
 
-#include <nerangake/object/heap_object.h>
+#include <nerangake/object/array.h>
+#include <nerangake/object/switch_table.h>
 
 namespace nrk {
 namespace object {
@@ -19,6 +20,7 @@ struct Captured {
  * - num_of_captured (int16_t)
  * - size_of_code (uint32_t)
  * - code (uintptr_t)
+ * - switch_tables (Array of SwitchTable, or Nil)
  * - captureds (Captured[num_of_captured])
  **/
 class Prototype : public HeapObject {
@@ -29,7 +31,8 @@ public:
         kNumOfCaptureds = kNumOfParams + sizeof(int8_t),
         kSizeOfCode = kNumOfCaptureds + sizeof(int16_t),
         kCode = kSizeOfCode + sizeof(uint32_t),
-        kCaptureds = kCode + sizeof(uintptr_t)
+        kSwitchTables = kCode + sizeof(uintptr_t),
+        kCaptureds = kSwitchTables + sizeof(uintptr_t)
     };
 
     IMPLICIT_CONSTRUCTORS(Prototype);
@@ -47,6 +50,18 @@ public:
 
     const Captured &captured(unsigned idx) const;
 
+    /**
+     * Jump tables of `kSwitch` instructions in `code`, indexed by their Bx.
+     */
+    uint32_t num_of_switch_tables() const;
+    const SwitchTable *switch_table(unsigned idx) const;
+    void set_switch_tables(Array *tables);
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kSwitchTables>(visitor);
+    }
+
 private:
     void set_code(const uint8_t *code);
     void set_size_of_code(uint32_t codesize);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <type_traits>
@@ -37,6 +38,10 @@ namespace object {
  * Use 01 to represent Fixnum, and the other two type values are fixed, that is
  * to say, other bits can record the data. Here, Special is used to represent
  * the remaining two types.
+ *
+ * Within Special, bits 2-3 select the kind: Nil, True, False, and ShortString.
+ * A ShortString keeps its bytes in the remaining bits of the word, see
+ * `ShortString` below.
  */
 class RawObject {
 public:
@@ -47,9 +52,10 @@ public:
     };
 
     enum Special {
-        kNil = 0x03,   // 0000_0011
-        kTrue = 0x06,  // 0000_0111
-        kFalse = 0x0B, // 0000_1011
+        kNil = 0x03,         // 0000_0011
+        kTrue = 0x07,        // 0000_0111
+        kFalse = 0x0B,       // 0000_1011
+        kShortString = 0x0F, // 0000_1111
     };
 
     enum {
@@ -62,6 +68,7 @@ public:
     IMPLICIT_CONSTRUCTORS(RawObject);
 
     static RawObject* Not(const RawObject*);
+    static RawObject* Len(const RawObject*);
     static RawObject* Add(const RawObject*, const RawObject*);
     static RawObject* Sub(const RawObject*, const RawObject*);
     static RawObject* Mul(const RawObject*, const RawObject*);
@@ -76,12 +83,13 @@ public:
     static RawObject* NE(const RawObject*, const RawObject*);
     static RawObject* Index(RawObject*, const RawObject*);
     static void SetIndex(RawObject*, const RawObject*, RawObject*);
+    static bool Next(RawObject*, uint32_t*, RawObject**, RawObject**);
     static bool True(const RawObject*);
     static bool NZ(const RawObject*);
 
     uintptr_t This() const { return reinterpret_cast<uintptr_t>(this); }
 
-    bool IsNil() const { return tag() == RawObject::kNil; }
+    bool IsNil() const { return This() == RawObject::kNil; }
 
     bool IsFixnum() const { return tag() == RawObject::kFixnum; }
 
@@ -91,6 +99,10 @@ public:
 
     bool IsObject() const { return tag() == RawObject::kObject; }
 
+    bool IsShortString() const {
+        return (This() & RawObject::kSpecialMask) == RawObject::kShortString;
+    }
+
     uintptr_t tag() const { return This() & RawObject::kTagMask; }
 
     /**
@@ -149,18 +161,26 @@ public:
 
 /**
  * Fixnum is the built-in numeric type of the virtual machine that
- * can express ranges [-2^29 - 1= -536870913, 2^29 = 536870912] values.
+ * can express ranges [-2^29 = -536870912, 2^29 - 1 = 536870911] values.
  */
 class Fixnum : public RawObject {
 public:
+    // Bounds such that the value shifted by the tag fits in 32 bits.
+    static const int32_t kMinValue = -(1 << 29);
+    static const int32_t kMaxValue = (1 << 29) - 1;
+
     IMPLICIT_CONSTRUCTORS(Fixnum);
 
+    static bool Fits(int64_t value) {
+        return kMinValue <= value && value <= kMaxValue;
+    }
+
     static Fixnum* Create(int32_t value) {
-        assert(
-            -536870913 <= value && 536870912 >= value &&
-            "integer value out of range");
+        assert(Fits(value) && "integer value out of range");
 
-        int32_t data = (value << RawObject::kTagShift) & kFixnum;
+        // Shift unsigned, shifting a negative value is undefined.
+        uint32_t bits = static_cast<uint32_t>(value) << RawObject::kTagShift;
+        int32_t data = static_cast<int32_t>(bits | kFixnum);
         RawObject* object = RawObject::From(static_cast<uintptr_t>(data));
         return object->As<Fixnum>();
     }
@@ -190,6 +210,58 @@ public:
     }
 };
 
+/**
+ * ShortString stores strings of at most `kMaxLength` bytes inside the tagged
+ * word itself, so that short keys cost no allocation and no GC tracing.
+ *
+ * +-----------------------+------------+----------+
+ * | bytes (7b or 3b)      | length (4) | 1111 (4) |
+ * +-----------------------+------------+----------+
+ *
+ * The byte at index `i` lives in the `i + 1`-th lowest byte of the word.
+ */
+class ShortString : public RawObject {
+public:
+    enum {
+        kLengthShift = 4,
+        kLengthMask = 0x0F,
+        kMaxLength = sizeof(uintptr_t) - 1,
+    };
+
+    IMPLICIT_CONSTRUCTORS(ShortString);
+
+    static bool Fits(size_t length) { return length <= kMaxLength; }
+
+    static ShortString* Create(const char* str, size_t length) {
+        assert(Fits(length) && "string too long to be inlined");
+
+        uintptr_t data = (length << kLengthShift) | kShortString;
+        for (size_t i = 0; i < length; ++i) {
+            uintptr_t byte = static_cast<uint8_t>(str[i]);
+            data |= byte << ((i + 1) * 8);
+        }
+        return RawObject::From(data)->As<ShortString>();
+    }
+
+    uint32_t length() const { return (This() >> kLengthShift) & kLengthMask; }
+
+    char At(unsigned idx) const {
+        assert(idx < length() && "out of string range");
+        return static_cast<char>(This() >> ((idx + 1) * 8));
+    }
+
+    /**
+     * Copy bytes into `buf`, which must hold at least `kMaxLength` bytes.
+     *
+     * @return  the length of string.
+     */
+    uint32_t Read(char* buf) const {
+        uint32_t len = length();
+        for (uint32_t i = 0; i < len; ++i) buf[i] = At(i);
+        return len;
+    }
+};
+
 static_assert(
     std::is_trivially_copyable<RawObject>::value,
     "class `RawObject` must be trivially copyable type.");
@@ -202,6 +274,9 @@ static_assert(
 static_assert(
     std::is_trivially_copyable<Nil>::value,
     "class `Nil` must be trivially copyable type.");
+static_assert(
+    std::is_trivially_copyable<ShortString>::value,
+    "class `ShortString` must be trivially copyable type.");
 
 } // namespace object
 } // namespace nrk
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+
+#include <nerangake/object/heap_object.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * RecordDescriptor describes the fixed layout of records, it is a constant
+ * declared along with the bytecode: the number of fields and the kind of
+ * each field.
+ *
+ * Object's layout
+ * - count (uint32_t)
+ * - kinds (FieldKind[count])
+ **/
+class RecordDescriptor : public HeapObject {
+public:
+    enum RecordDescriptorLayout {
+        kCount = kFieldStart,
+        kKinds = kCount + sizeof(uint32_t),
+    };
+
+    enum FieldKind : uint8_t {
+        kAny,
+        kFixnum,
+        // unboxed, it is boxed on load.
+        kDouble,
+    };
+
+    IMPLICIT_CONSTRUCTORS(RecordDescriptor);
+
+    static size_t Size(uint32_t count) {
+        return sizeof(uint32_t) + count * sizeof(FieldKind);
+    }
+
+    static RecordDescriptor *Create(const std::vector<FieldKind> &kinds);
+
+    uint32_t count() const { return GetFieldAs<uint32_t, kCount>(); }
+
+    FieldKind kind(uint32_t idx) const {
+        return GetArrayFieldAs<FieldKind, kKinds>()[idx];
+    }
+
+private:
+    void set_count(uint32_t count) { SetField<kCount>(count); }
+
+    void set_kind(uint32_t idx, FieldKind kind) {
+        SetArrayField<kKinds>(idx, kind);
+    }
+};
+
+/**
+ * Record is a fixed set of fields addressed by index, one word per field
+ * behind a pointer to its descriptor. There is neither hashing nor
+ * allocation per field, fields of `kDouble` kind are stored unboxed and
+ * skipped by GC.
+ *
+ * Object's layout
+ * - RecordDescriptor (descriptor)
+ * - fields (RawObject or double [count])
+ **/
+class Record : public HeapObject {
+public:
+    enum RecordLayout {
+        kDescriptor = kFieldStart,
+        kFields = kDescriptor + sizeof(uintptr_t),
+    };
+
+    IMPLICIT_CONSTRUCTORS(Record);
+
+    static size_t Size(uint32_t count) {
+        return sizeof(uintptr_t) + count * sizeof(Element);
+    }
+
+    static Record *Create(RecordDescriptor *descriptor);
+
+    const RecordDescriptor *descriptor() const {
+        return GetFieldAs<RecordDescriptor *, kDescriptor>();
+    }
+
+    uint32_t count() const { return descriptor()->count(); }
+
+    Element Get(uint32_t idx);
+
+    /**
+     * Store `e` to the field `idx`, `e` must fit the kind of the field.
+     */
+    void Set(uint32_t idx, Element e);
+
+    /**
+     * The layout is read before the descriptor is visited: once forwarded,
+     * it may point where a compacting GC hasn't moved it yet.
+     */
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        // Unboxed doubles aren't references.
+        const RecordDescriptor *descriptor = this->descriptor();
+        uint32_t count = descriptor->count();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (descriptor->kind(i) == RecordDescriptor::kAny)
+                VisitSlot(visitor, &fields()[i]);
+        }
+
+        VisitField<kDescriptor>(visitor);
+    }
+
+private:
+    void set_descriptor(HeapObject *descriptor) {
+        SetField<kDescriptor>(descriptor);
+    }
+
+    Element *fields() { return GetArrayFieldAs<Element, kFields>(); }
+
+    double *doubles() { return GetArrayFieldAs<double, kFields>(); }
+};
+
+static_assert(
+    std::is_trivially_copyable<RecordDescriptor>::value,
+    "class `RecordDescriptor` must be trivially copyable type.");
+static_assert(
+    std::is_trivially_copyable<Record>::value,
+    "class `Record` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
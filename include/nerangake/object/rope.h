@@ -0,0 +1,81 @@
+#pragma once
+
+#include <nerangake/object/string.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * Rope is a lazy concatenation of two strings (`String`, `ShortString` or
+ * `Rope`), so that building a long string piece by piece costs linear time.
+ * Indexing, hashing and comparing walk its pieces without allocating, it is
+ * flattened into a `String` only when sliced, and the result is cached in
+ * `left` with `right` set to Nil.
+ *
+ * Object's layout
+ * - length (uint32_t)
+ * - left (RawObject)
+ * - right (RawObject)
+ **/
+class Rope : public HeapObject {
+public:
+    enum RopeLayout {
+        kLength = kFieldStart,
+        kLeft = kLength + sizeof(uintptr_t),
+        kRight = kLeft + sizeof(Element),
+    };
+
+    enum {
+        // Concatenations not longer than this are copied directly.
+        kFlatLimit = 32,
+    };
+
+    IMPLICIT_CONSTRUCTORS(Rope);
+
+    static size_t Size() { return sizeof(uintptr_t) + sizeof(Element) * 2; }
+
+    /**
+     * Concatenate two strings, only short results are copied, the others
+     * are linked by a new `Rope`.
+     */
+    static RawObject *Concat(RawObject *lhs, RawObject *rhs);
+
+    /**
+     * Flatten `obj` if it is a `Rope`, otherwise return `obj` itself.
+     */
+    static RawObject *Flatten(RawObject *obj);
+
+    uint32_t length() const { return GetFieldAs<uint32_t, kLength>(); }
+
+    bool flattened() const { return right()->IsNil(); }
+
+    Element left() { return GetFieldAs<Element, kLeft>(); }
+
+    const Element left() const { return GetFieldAs<Element, kLeft>(); }
+
+    Element right() { return GetFieldAs<Element, kRight>(); }
+
+    const Element right() const { return GetFieldAs<Element, kRight>(); }
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kLeft>(visitor);
+        VisitField<kRight>(visitor);
+    }
+
+private:
+    static Rope *Create(RawObject *lhs, RawObject *rhs, uint32_t length);
+
+    void set_length(uint32_t length) { SetField<kLength>(length); }
+
+    void set_left(Element left) { SetField<kLeft>(left); }
+
+    void set_right(Element right) { SetField<kRight>(right); }
+};
+
+static_assert(
+    std::is_trivially_copyable<Rope>::value,
+    "class `Rope` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <nerangake/object/heap_object.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * Shape is the hidden class of a string-keyed `HashMap`. Shapes form a
+ * transition tree from `Shape::Root()`: adding key `k` to a map of shape `S`
+ * moves it to the child of `S` keyed by `k`, so maps built with the same keys
+ * in the same order share a shape, and store only values, indexed by slot.
+ *
+ * Only `ShortString` keys are kept in shapes, they are compared by identity
+ * and never keep heap objects alive.
+ *
+ * Shapes are never collected, so the tree is bounded: a shape has at most
+ * `kMaxChildren` transitions and the whole tree at most `kMaxShapes` shapes,
+ * maps which would need more go to dictionary mode. Transitions are indexed
+ * by key in a small open addressing table of `kChildSlots` slots.
+ *
+ * Object's layout
+ * - count (uint32_t)       number of keys, this key lives at slot count - 1
+ * - nchildren (uint32_t)   number of transitions
+ * - key (RawObject)        Nil for root
+ * - parent (Shape)         Nil for root
+ * - children (Array)       Nil if no transition
+ **/
+class Shape : public HeapObject {
+public:
+    enum ShapeLayout {
+        kCount = kFieldStart,
+        kChildCount = kCount + sizeof(uint32_t),
+        kKey = kCount + sizeof(uintptr_t),
+        kParent = kKey + sizeof(Element),
+        kChildren = kParent + sizeof(Element),
+    };
+
+    enum {
+        // Maps with more keys fall back to dictionary mode.
+        kMaxKeys = 32,
+        kMaxChildren = 8,
+        kChildSlots = 16,
+        kMaxShapes = 1 << 16,
+        kNotFound = -1,
+    };
+
+    IMPLICIT_CONSTRUCTORS(Shape);
+
+    static size_t Size() { return sizeof(uintptr_t) + sizeof(Element) * 3; }
+
+    /**
+     * The shape of empty map, it is shared by the whole virtual machine.
+     */
+    static Shape *Root();
+
+    static bool IsValidKey(const RawObject *key) {
+        return key->IsShortString();
+    }
+
+    uint32_t count() const { return GetFieldAs<uint32_t, kCount>(); }
+
+    const Element key() const { return GetFieldAs<Element, kKey>(); }
+
+    Shape *parent() { return GetFieldAs<Shape *, kParent>(); }
+
+    bool IsRoot() const { return GetFieldAs<Element, kParent>()->IsNil(); }
+
+    /**
+     * @return  the slot of `key`, or kNotFound.
+     */
+    int32_t Lookup(const RawObject *key) const;
+
+    /**
+     * @return  whether `Transition(key)` is allowed, it exists or the tree
+     *          has room for it.
+     */
+    bool CanTransition(const RawObject *key);
+
+    /**
+     * @return  the shape with `key` appended, it is created if not exists.
+     */
+    Shape *Transition(const RawObject *key);
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kParent>(visitor);
+        VisitField<kChildren>(visitor);
+    }
+
+private:
+    static Shape *Create(uint32_t count, const RawObject *key, Element parent);
+
+    /**
+     * @return  the transition keyed by `key`, or nullptr.
+     */
+    Shape *FindChild(const RawObject *key);
+
+    Element children() { return GetFieldAs<Element, kChildren>(); }
+
+    uint32_t child_count() const { return GetFieldAs<uint32_t, kChildCount>(); }
+
+    void set_count(uint32_t count) { SetField<kCount>(count); }
+
+    void set_child_count(uint32_t count) { SetField<kChildCount>(count); }
+
+    void set_key(const RawObject *key) {
+        SetField<kKey>(const_cast<RawObject *>(key));
+    }
+
+    void set_parent(Element parent) { SetField<kParent>(parent); }
+
+    void set_children(Element children) { SetField<kChildren>(children); }
+};
+
+static_assert(
+    std::is_trivially_copyable<Shape>::value,
+    "class `Shape` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
@@ -22,7 +22,7 @@ public:
         kDepth = kFieldStart,
         kOffset = kDepth + sizeof(uint32_t),
         kTop = kOffset + sizeof(uint32_t),
-        kArray = kDepth + sizeof(Element)
+        kArray = kTop + sizeof(Element)
     };
 
     IMPLICIT_CONSTRUCTORS(Stack);
@@ -46,7 +46,11 @@ public:
     void Set(unsigned offset, Element e);
     size_t Length() const;
 
-    void Children(const ForwardingCallback& cb);
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kTop>(visitor);
+        VisitField<kArray>(visitor);
+    }
 
 private:
     void set_top(Element e);
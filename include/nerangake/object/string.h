@@ -15,6 +15,12 @@ public:
         kBuffer = kLength + 4,
     };
 
+    enum {
+        // The longest string whose object, padding included, still fits the
+        // 24-bit size of the object header.
+        kMaxLength = (1 << 24) - kBuffer - 16,
+    };
+
     IMPLICIT_CONSTRUCTORS(String);
 
     static size_t Size(size_t length) {
@@ -25,6 +31,20 @@ public:
     static String *Create(const char *str, size_t length);
     static String *CreateGlobal(const char *str, size_t length);
 
+    /**
+     * Create an immediate `ShortString` if `length` fits into the tagged
+     * word, otherwise allocate a `String` on heap.
+     */
+    static RawObject *New(const char *str, size_t length);
+
+    // The following operations accept `String`, `ShortString`, `Rope` and
+    // `StringSlice`.
+    static bool IsString(const RawObject *obj);
+    static uint32_t LengthOf(const RawObject *obj);
+    static char CharAt(const RawObject *obj, unsigned idx);
+    static uint32_t HashCode(const RawObject *obj);
+    static bool Equals(const RawObject *lhs, const RawObject *rhs);
+
     char At(unsigned idx) const;
 
     uint32_t length() const;
@@ -32,6 +52,9 @@ public:
     const char *buffer() const;
 
 private:
+    // `StringSlice` copies itself out as a flat `String` during GC.
+    friend class StringSlice;
+
     static void Init(String *string, const char *str, size_t length);
 
     char *buffer();
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <nerangake/object/string.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * StringSlice is a view of `length` bytes starting at `offset` of its parent
+ * `String`, so substrings share the parent buffer instead of copying it.
+ *
+ * When a tiny slice of a large parent survives a collection, the GC copies it
+ * out as a flat `String` (see `ShouldCopyOut`), so that the parent could be
+ * released.
+ *
+ * Object's layout
+ * - offset (uint32_t)
+ * - length (uint32_t)
+ * - parent (String)
+ **/
+class StringSlice : public HeapObject {
+public:
+    enum StringSliceLayout {
+        kOffset = kFieldStart,
+        kLength = kOffset + sizeof(uint32_t),
+        kParent = kLength + sizeof(uint32_t),
+    };
+
+    enum {
+        // Substrings not longer than this are copied directly.
+        kMinLength = 16,
+        // A surviving slice is copied out if its parent is at least
+        // `kCopyOutParentLength` bytes and `kCopyOutRatio` times longer.
+        kCopyOutParentLength = 256,
+        kCopyOutRatio = 4,
+    };
+
+    IMPLICIT_CONSTRUCTORS(StringSlice);
+
+    static size_t Size() { return sizeof(uint32_t) * 2 + sizeof(uintptr_t); }
+
+    /**
+     * Take `length` bytes starting at `offset` of string `obj`, which could
+     * be any string representation.
+     */
+    static RawObject *Sub(RawObject *obj, uint32_t offset, uint32_t length);
+
+    uint32_t offset() const { return GetFieldAs<uint32_t, kOffset>(); }
+
+    uint32_t length() const { return GetFieldAs<uint32_t, kLength>(); }
+
+    const String *parent() const { return GetFieldAs<String *, kParent>(); }
+
+    const char *buffer() const { return parent()->buffer() + offset(); }
+
+    char At(unsigned idx) const;
+
+    bool ShouldCopyOut() const;
+
+    // Size of the flat `String` replaces this slice, header included.
+    size_t CopyOutSize() const;
+
+    /**
+     * Write a flat `String` with the same content at `target`, which has
+     * `CopyOutSize()` bytes. Only the GC meta-info is left to the caller.
+     */
+    void CopyOut(HeapObject *target) const;
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kParent>(visitor);
+    }
+
+private:
+    static StringSlice *Create(
+        const String *parent, uint32_t offset, uint32_t length);
+
+    void set_offset(uint32_t offset) { SetField<kOffset>(offset); }
+
+    void set_length(uint32_t length) { SetField<kLength>(length); }
+
+    void set_parent(const String *parent) { SetField<kParent>(parent); }
+};
+
+static_assert(
+    std::is_trivially_copyable<StringSlice>::value,
+    "class `StringSlice` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <nerangake/object/heap_object.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * SwitchTable is the jump table of `kSwitch`, it maps a case key to a jump
+ * offset relative to the switch instruction, in O(1) instead of a chain of
+ * comparisons.
+ *
+ * A dense table covers consecutive Fixnum keys [low, low + size) and is
+ * indexed directly. A hashed table covers sparse keys, with open addressing
+ * and linear probing over `size` (power of two) slots. Case keys are
+ * immediates, Fixnum or `ShortString`, so a table holds no reference and is
+ * never scanned by GC. Keys not covered jump to the default offset.
+ *
+ * Object's layout
+ * - kind (uint32_t)
+ * - size (uint32_t)
+ * - low (int32_t)              dense only
+ * - default (int32_t)
+ * - keys (RawObject[size])     hashed only, Nil if empty
+ * - targets (int32_t[size])
+ **/
+class SwitchTable : public HeapObject {
+public:
+    enum SwitchTableLayout {
+        kKind = kFieldStart,
+        kSize = kKind + sizeof(uint32_t),
+        kLow = kSize + sizeof(uint32_t),
+        kDefault = kLow + sizeof(int32_t),
+        kEntries = kDefault + sizeof(int32_t),
+    };
+
+    enum Kind : uint32_t {
+        kDense,
+        kHashed,
+    };
+
+    typedef std::pair<RawObject *, int32_t> Case;
+
+    IMPLICIT_CONSTRUCTORS(SwitchTable);
+
+    static bool IsValidKey(const RawObject *key) {
+        return key->IsFixnum() || key->IsShortString();
+    }
+
+    /**
+     * @param low       key of `targets[0]`.
+     * @param targets   offsets of keys [low, low + targets.size()).
+     */
+    static SwitchTable *CreateDense(
+        int32_t low, const std::vector<int32_t> &targets,
+        int32_t default_target);
+
+    static SwitchTable *CreateHashed(
+        const std::vector<Case> &cases, int32_t default_target);
+
+    Kind kind() const {
+        return static_cast<Kind>(GetFieldAs<uint32_t, kKind>());
+    }
+
+    uint32_t size() const { return GetFieldAs<uint32_t, kSize>(); }
+
+    int32_t low() const { return GetFieldAs<int32_t, kLow>(); }
+
+    int32_t default_target() const { return GetFieldAs<int32_t, kDefault>(); }
+
+    /**
+     * @return  jump offset of `key`, or the default one.
+     */
+    int32_t Target(const RawObject *key) const;
+
+private:
+    static size_t Size(Kind kind, uint32_t size);
+    static SwitchTable *Create(
+        Kind kind, uint32_t size, int32_t low, int32_t default_target);
+
+    const RawObject *const *keys() const {
+        return GetArrayFieldAs<const RawObject *, kEntries>();
+    }
+
+    const RawObject **keys() {
+        return GetArrayFieldAs<const RawObject *, kEntries>();
+    }
+
+    const int32_t *targets() const {
+        const uint32_t skip = kind() == kHashed ? size() : 0;
+        return reinterpret_cast<const int32_t *>(keys() + skip);
+    }
+
+    int32_t *targets() {
+        const SwitchTable *thiz = this;
+        return const_cast<int32_t *>(thiz->targets());
+    }
+
+    uint32_t Probe(const RawObject *key) const;
+};
+
+static_assert(
+    std::is_trivially_copyable<SwitchTable>::value,
+    "class `SwitchTable` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
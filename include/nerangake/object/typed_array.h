@@ -0,0 +1,104 @@
+#pragma once
+
+#include <nerangake/object/heap_object.h>
+#include <nerangake/simd/kernels.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * TypedArray is a fixed length array of unboxed numbers of one element
+ * type: Float64Array, Int32Array or Int64Array. Whole-array operations run
+ * SIMD kernels (see `simd::Float64Kernels`), so one instruction replaces a
+ * loop of `kIndex`/`kAdd`/`kSetIndex`.
+ *
+ * Object's layout
+ * - element_type (uint32_t)
+ * - length (uint32_t)
+ * - data (double, int32_t or int64_t [length])
+ **/
+class TypedArray : public HeapObject {
+public:
+    enum TypedArrayLayout {
+        kElementType = kFieldStart,
+        kLength = kElementType + sizeof(uint32_t),
+        kData = kLength + sizeof(uint32_t),
+    };
+
+    enum ElementType : uint32_t {
+        kFloat64,
+        kInt32,
+        kInt64,
+    };
+
+    IMPLICIT_CONSTRUCTORS(TypedArray);
+
+    static size_t ElementSize(ElementType type) {
+        return type == kInt32 ? sizeof(int32_t) : sizeof(int64_t);
+    }
+
+    static size_t Size(ElementType type, uint32_t length) {
+        return sizeof(uint32_t) * 2 + ElementSize(type) * length;
+    }
+
+    static TypedArray *Create(ElementType type, uint32_t length);
+
+    /**
+     * Element-wise `lhs op rhs` into a new array, `rhs` is either an array
+     * of the same type and length or a number broadcast to every element.
+     */
+    static TypedArray *Binary(
+        simd::BinaryOp op, RawObject *lhs, RawObject *rhs);
+
+    /**
+     * acc += lhs * rhs, in place.
+     */
+    static void Fma(RawObject *acc, RawObject *lhs, RawObject *rhs);
+
+    /**
+     * @return  sum, min or max of elements, min and max of empty array are
+     *          Nil.
+     */
+    static RawObject *Reduce(simd::ReduceOp op, RawObject *array);
+
+    static RawObject *Dot(RawObject *lhs, RawObject *rhs);
+
+    /**
+     * @return  Int32Array of 1 where `lhs op rhs` holds, 0 otherwise.
+     */
+    static TypedArray *Compare(
+        simd::CompareOp op, RawObject *lhs, RawObject *rhs);
+
+    ElementType element_type() const {
+        return static_cast<ElementType>(GetFieldAs<uint32_t, kElementType>());
+    }
+
+    uint32_t length() const { return GetFieldAs<uint32_t, kLength>(); }
+
+    Element Get(uint32_t idx) const;
+    void Set(uint32_t idx, const RawObject *value);
+
+    template <typename T>
+    T *data() {
+        return GetArrayFieldAs<T, kData>();
+    }
+
+    template <typename T>
+    const T *data() const {
+        return GetArrayFieldAs<T, kData>();
+    }
+
+private:
+    void set_element_type(ElementType type) {
+        SetField<kElementType>(static_cast<uint32_t>(type));
+    }
+
+    void set_length(uint32_t length) { SetField<kLength>(length); }
+};
+
+static_assert(
+    std::is_trivially_copyable<TypedArray>::value,
+    "class `TypedArray` must be trivially copyable type.");
+
+} // namespace object
+} // namespace nrk
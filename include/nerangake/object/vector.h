@@ -1,15 +1,23 @@
 #pragma once
 
 #include <nerangake/object/array.h>
+#include <nerangake/object/packed_array.h>
 
 namespace nrk {
 namespace object {
 
 /**
+ * Vector tracks the kind of its elements. A vector holding only Fixnums or
+ * only numbers keeps them unboxed in a `PackedArray` (8 bytes each, no GC
+ * object per element), otherwise elements are boxed in an `Array`. Kinds only
+ * move forward: packed fixnum -> packed double -> generic, on the first store
+ * that doesn't fit.
+ *
  * Object's layout
  * - capacity (uint32_t)
  * - length (uint32_t)
- * - Array array
+ * - kind (uint32_t)
+ * - Array or PackedArray (array)
  **/
 class Vector : public HeapObject {
     typedef RawObject *Element;
@@ -18,7 +26,14 @@ public:
     enum VectorLayout {
         kCapacity = kFieldStart,
         kLength = kCapacity + sizeof(uint32_t),
-        kArray = kLength + sizeof(uint32_t)
+        kKind = kLength + sizeof(uint32_t),
+        kArray = kKind + sizeof(uintptr_t)
+    };
+
+    enum ElementKind : uint32_t {
+        kPackedFixnum,
+        kPackedDouble,
+        kGeneric,
     };
 
     IMPLICIT_CONSTRUCTORS(Vector);
@@ -26,9 +41,24 @@ public:
     static size_t Size();
     static Vector *Create(size_t size = 16);
 
+    /**
+     * @return  the least kind which could hold `e`.
+     */
+    static ElementKind KindOf(const RawObject *e);
+
+    /**
+     * @return  a new vector of elements `[begin, end)` of `src`, in the same
+     *          kind as `src`.
+     */
+    static Vector *Slice(Vector *src, uint32_t begin, uint32_t end);
+
     uint32_t length() const;
     uint32_t capacity() const;
 
+    ElementKind kind() const {
+        return static_cast<ElementKind>(GetFieldAs<uint32_t, kKind>());
+    }
+
     bool Empty() const;
     Element Get(unsigned idx);
     const Element Get(unsigned idx) const;
@@ -36,16 +66,62 @@ public:
     void Push(Element e);
     Element Pop();
 
-    void Children(const ForwardingCallback &cb);
+    /**
+     * Bulk operations on ranges `[begin, end)`. Elements are moved with
+     * `memmove`, and a generic buffer takes one write barrier per operation
+     * instead of one per element.
+     */
+    void Reserve(uint32_t capacity);
+
+    /**
+     * Reserve `capacity` and widen the kind to hold elements up to `kind`,
+     * so that pushing such elements doesn't allocate.
+     */
+    void Reserve(uint32_t capacity, ElementKind kind);
+    void Append(Vector *src);
+    void AppendRange(Vector *src, uint32_t begin, uint32_t end);
+    void Fill(Element e, uint32_t begin, uint32_t end);
+    void CopyWithin(uint32_t target, uint32_t begin, uint32_t end);
+
+    // Unchecked access of packed kinds, `idx` must be less than length.
+    int64_t IntAt(unsigned idx) const { return packed()->ints()[idx]; }
+
+    double DoubleAt(unsigned idx) const { return packed()->doubles()[idx]; }
+
+    void SetIntAt(unsigned idx, int64_t value) {
+        packed()->ints()[idx] = value;
+    }
+
+    void SetDoubleAt(unsigned idx, double value) {
+        packed()->doubles()[idx] = value;
+    }
+
+    template <typename Visitor>
+    void VisitPointers(Visitor &visitor) {
+        VisitField<kArray>(visitor);
+    }
 
 private:
     void Extend();
+    void Grow(uint32_t capacity);
+    void Transition(ElementKind kind);
+    void StoreAt(unsigned idx, Element e);
+    void CopyRange(uint32_t at, Vector *src, uint32_t begin, uint32_t count);
 
     void set_length(uint32_t);
     void set_capacity(uint32_t);
-    void set_buffer(Array *array);
+    void set_kind(ElementKind kind) {
+        SetField<kKind>(static_cast<uint32_t>(kind));
+    }
+    void set_buffer(HeapObject *array);
     const Array *buffer() const;
     Array *buffer();
+
+    const PackedArray *packed() const {
+        return GetFieldAs<PackedArray *, kArray>();
+    }
+
+    PackedArray *packed() { return GetFieldAs<PackedArray *, kArray>(); }
 };
 
 static_assert(
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <nerangake/object/call_info.h>
+#include <nerangake/object/hash_map.h>
+#include <nerangake/object/record.h>
+#include <nerangake/object/rope.h>
+#include <nerangake/object/stack.h>
+#include <nerangake/object/string_slice.h>
+#include <nerangake/object/vector.h>
+
+namespace nrk {
+namespace object {
+
+/**
+ * VisitPointers - pass each object referenced by `obj` to `visitor`, and
+ * store back the returned one.
+ *
+ * `visitor` is any callable taking and returning `HeapObject *`. Dispatch is
+ * a switch over the type and each class walks its fields in an inline
+ * template, so the whole walk is inlined into the collector instead of an
+ * indirect call per reference.
+ */
+template <typename Visitor>
+void VisitPointers(HeapObject *obj, Visitor &&visitor) {
+#define VISIT_POINTERS(name)                                  \
+    case HeapObject::k##name:                                 \
+        HeapObject::Cast<name>(obj)->VisitPointers(visitor);  \
+        break;
+
+    switch (obj->type()) {
+        VISIT_POINTERS(Array)
+        VISIT_POINTERS(CallInfo)
+        VISIT_POINTERS(Closure)
+        VISIT_POINTERS(HashMap)
+        VISIT_POINTERS(HashTable)
+        VISIT_POINTERS(Prototype)
+        VISIT_POINTERS(Record)
+        VISIT_POINTERS(Rope)
+        VISIT_POINTERS(Shape)
+        VISIT_POINTERS(Stack)
+        VISIT_POINTERS(StringSlice)
+        VISIT_POINTERS(Vector)
+        default:
+            // The others hold no reference.
+            break;
+    }
+
+#undef VISIT_POINTERS
+}
+
+} // namespace object
+} // namespace nrk
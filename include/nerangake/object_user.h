@@ -12,15 +12,24 @@ public:
     using Boolean = object::Boolean;
     using Fixnum = object::Fixnum;
     using Nil = object::Nil;
+    using ShortString = object::ShortString;
 
 	using Array = object::Array;
     using CallInfo = object::CallInfo;
     using Closure = object::Closure;
     using Float = object::Float;
     using HashMap = object::HashMap;
+    using PackedArray = object::PackedArray;
     using Prototype = object::Prototype;
+    using Record = object::Record;
+    using RecordDescriptor = object::RecordDescriptor;
+    using Rope = object::Rope;
+    using Shape = object::Shape;
     using Stack = object::Stack;
     using String = object::String;
+    using StringSlice = object::StringSlice;
+    using SwitchTable = object::SwitchTable;
+    using TypedArray = object::TypedArray;
     using Vector = object::Vector;
     using UserClosure = object::UserClosure;
 
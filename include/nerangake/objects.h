@@ -8,8 +8,16 @@
 #include <nerangake/object/closure.h>
 #include <nerangake/object/float.h>
 #include <nerangake/object/hash_map.h>
+#include <nerangake/object/packed_array.h>
 #include <nerangake/object/prototype.h>
+#include <nerangake/object/record.h>
+#include <nerangake/object/rope.h>
+#include <nerangake/object/shape.h>
 #include <nerangake/object/stack.h>
 #include <nerangake/object/string.h>
+#include <nerangake/object/string_slice.h>
+#include <nerangake/object/switch_table.h>
+#include <nerangake/object/typed_array.h>
 #include <nerangake/object/user_closure.h>
-#include <nerangake/object/vector.h>
\ No newline at end of file
+#include <nerangake/object/vector.h>
+#include <nerangake/object/visitor.h>
\ No newline at end of file
@@ -77,11 +77,55 @@ enum class OPCode {
     kReturn,     // return [A...B)
     kReturnVoid, // return
 
-    kNewHash,     // A = Hash
-    kNewArray,    // A = Vector
+    kNewHash,     // A = Hash, presized for B array and C hash keys
+    kNewArray,    // A = Vector, presized for B elements if B isn't 0
     kNewClosure,  // A = Prototype[Bx]
     kUserClosure, // A = UserClosure[Bx]
     kHalt,        // stop
+
+    // New opcodes are appended here, after `kHalt`, so that encodings of
+    // existing bytecode never change.
+    kLen, // A = #B
+
+    // string
+    kConcat, // A = B .. ... .. C
+    kSlice,  // A = B[C, C + 1), B is a string or a vector
+
+    // vector, ranges are [C, C + 1) like kSlice
+    kReserve,    // A.reserve(B)
+    kExtend,     // A.append(B)
+    kFill,       // A[C, C + 1) = B
+    kCopyWithin, // A[B, ...) = A[C, C + 1)
+    kAppend,     // A.append(B)
+    kSetList,    // A.append(A + 1 ... A + B), A = Vector if A is Nil
+
+    // typed array, C of element-wise ops may be a number to broadcast
+    kNewTyped, // A = TypedArray(type B, length C)
+    kVAdd,     // A = B + C
+    kVSub,     // A = B - C
+    kVMul,     // A = B * C
+    kVDiv,     // A = B / C
+    kVFma,     // A += B * C
+    kVSum,     // A = sum(B)
+    kVMin,     // A = min(B)
+    kVMax,     // A = max(B)
+    kVDot,     // A = dot(B, C)
+    kVLT,      // A = B < C, Int32Array of 1 or 0
+    kVLE,      // A = B <= C
+    kVEQ,      // A = B == C
+
+    kGetField, // A = B.fields[C], B is a Record
+    kSetField, // A.fields[B] = C
+
+    // jump table of current prototype, see `SwitchTable`
+    kSwitch, // PC += SwitchTable(Bx)[A]
+
+    // iteration over string, vector, typed array and map, A + 1 holds the
+    // cursor, which is a position, so nothing is allocated per loop
+    kIterPrep, // A = B, A + 1 = 0
+    kIterNext, // A + 2, A + 3 = next key, value of A; if none PC += C
+
+    kNewRecord, // A = Record(RecordDescriptor[Bx])
 };
 
 } // namespace nrk
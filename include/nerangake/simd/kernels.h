@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace nrk {
+namespace simd {
+
+enum class BinaryOp { kAdd, kSub, kMul, kDiv };
+enum class ReduceOp { kSum, kMin, kMax };
+enum class CompareOp { kLT, kLE, kEQ };
+
+/**
+ * Element-wise kernels over contiguous arrays. `b` is a single value
+ * broadcast to every element if `broadcast` is set, otherwise an array of
+ * `n` elements. Comparisons write 1 or 0 into `dst`.
+ */
+struct Float64Kernels {
+    const char *name;
+    void (*binary)(
+        BinaryOp op, double *dst, const double *a, const double *b, size_t n,
+        bool broadcast);
+    // dst += a * b
+    void (*fma)(
+        double *dst, const double *a, const double *b, size_t n,
+        bool broadcast);
+    // min and max of empty array are NaN
+    double (*reduce)(ReduceOp op, const double *a, size_t n);
+    double (*dot)(const double *a, const double *b, size_t n);
+    void (*compare)(
+        CompareOp op, int32_t *dst, const double *a, const double *b,
+        size_t n, bool broadcast);
+};
+
+/**
+ * @return  kernels for doubles, selected once by the features of running
+ *          CPU: AVX2 with FMA, SSE2, or scalar.
+ */
+const Float64Kernels &Float64();
+
+/**
+ * Integer kernels wrap on overflow and throw on division by zero, they are
+ * plain loops left to the compiler's vectorizer. Sums and dot products
+ * accumulate in int64_t, `Reduce` requires `n > 0` for min and max.
+ *
+ * Instantiated for int32_t and int64_t.
+ */
+template <typename T>
+void Binary(
+    BinaryOp op, T *dst, const T *a, const T *b, size_t n, bool broadcast);
+
+template <typename T>
+void Fma(T *dst, const T *a, const T *b, size_t n, bool broadcast);
+
+template <typename T>
+int64_t Reduce(ReduceOp op, const T *a, size_t n);
+
+template <typename T>
+int64_t Dot(const T *a, const T *b, size_t n);
+
+template <typename T>
+void Compare(
+    CompareOp op, int32_t *dst, const T *a, const T *b, size_t n,
+    bool broadcast);
+
+} // namespace simd
+} // namespace nrk
@@ -18,6 +18,7 @@ public:
     virtual void AddInteger(Fixnum *fixnum) = 0;
     virtual void AddFloat(Float *f) = 0;
     virtual void AddString(String *string) = 0;
+    virtual void AddRecordDescriptor(RecordDescriptor *descriptor) = 0;
 
     virtual bool IsUserClosureExists(const std::string &str) const = 0;
 
@@ -29,25 +29,55 @@ public:
     virtual void AddInteger(Fixnum *fixnum) override;
     virtual void AddFloat(Float *f) override;
     virtual void AddString(String *string) override;
+    virtual void AddRecordDescriptor(RecordDescriptor *descriptor) override;
 
     virtual bool IsUserClosureExists(const std::string &str) const override;
 
     virtual void ProcessRootObject(const Callback &cb) override;
 
 private:
+    /**
+     * InlineCache remembers the shape and slot last seen by a `kIndex` or
+     * `kSetIndex` instruction, so that a hit costs a shape check plus a load.
+     * Keys are `ShortString`, compared by identity.
+     */
+    struct InlineCache {
+        RawObject *shape; // nullptr if empty
+        RawObject *key;
+        uint32_t slot;
+    };
+
     CallInfo *LastCallInfo(VMScene *scene);
 
+    InlineCache *FindInlineCache(const uint8_t *pc);
+    void UpdateInlineCache(InlineCache *ic, HashMap *map, RawObject *key);
+
     bool Disptach(VMScene *scene, const uint8_t *pc);
     void ExecuteGoto(VMScene *scene);
     void ExecuteNot(VMScene *scene);
     void ExecuteInc(VMScene *scene);
     void ExecuteDec(VMScene *scene);
+    void ExecuteLen(VMScene *scene);
     void ExecuteAdd(VMScene *scene);
     void ExecuteSub(VMScene *scene);
     void ExecuteMul(VMScene *scene);
     void ExecuteDiv(VMScene *scene);
     void ExecuteMod(VMScene *scene);
     void ExecutePow(VMScene *scene);
+    void ExecuteConcat(VMScene *scene);
+    void ExecuteSlice(VMScene *scene);
+    void ExecuteReserve(VMScene *scene);
+    void ExecuteExtend(VMScene *scene);
+    void ExecuteFill(VMScene *scene);
+    void ExecuteCopyWithin(VMScene *scene);
+    void ExecuteAppend(VMScene *scene);
+    void ExecuteSetList(VMScene *scene);
+    void ExecuteNewTyped(VMScene *scene);
+    void ExecuteVBinary(VMScene *scene, simd::BinaryOp op);
+    void ExecuteVFma(VMScene *scene);
+    void ExecuteVReduce(VMScene *scene, simd::ReduceOp op);
+    void ExecuteVDot(VMScene *scene);
+    void ExecuteVCompare(VMScene *scene, simd::CompareOp op);
     void ExecuteGT(VMScene *scene);
     void ExecuteGE(VMScene *scene);
     void ExecuteLT(VMScene *scene);
@@ -67,6 +97,8 @@ private:
     void ExecuteStoreCaptured(VMScene *scene);
     void ExecuteIndex(VMScene *scene);
     void ExecuteSetIndex(VMScene *scene);
+    void ExecuteGetField(VMScene *scene);
+    void ExecuteSetField(VMScene *scene);
     void ExecuteIf(VMScene *scene);
     void ExecuteBEQ(VMScene *scene);
     void ExecuteBNE(VMScene *scene);
@@ -76,6 +108,9 @@ private:
     void ExecuteBLE(VMScene *scene);
     void ExecuteBZ(VMScene *scene);
     void ExecuteBNZ(VMScene *scene);
+    void ExecuteSwitch(VMScene *scene);
+    void ExecuteIterPrep(VMScene *scene);
+    void ExecuteIterNext(VMScene *scene);
     void ExecutePush(VMScene *scene);
     void ExecutePushN(VMScene *scene);
     void ExecutePop(VMScene *scene);
@@ -85,6 +120,7 @@ private:
     void ExecuteReturnVoid(VMScene *scene);
     void ExecuteNewHash(VMScene *scene);
     void ExecuteNewArray(VMScene *scene);
+    void ExecuteNewRecord(VMScene *scene);
     void ExecuteNewClosure(VMScene *scene);
     void ExecuteNewUserClosure(VMScene *scene);
 
@@ -94,13 +130,18 @@ private:
     std::vector<Prototype *> prototypes_;
     std::vector<Fixnum *> fixnums_;
     std::vector<Float *> floats_;
-    std::vector<String *> strings_;
+    // `String` or `ShortString`
+    std::vector<RawObject *> strings_;
+    std::vector<RecordDescriptor *> record_descriptors_;
 
     std::vector<RawObject *> globals_;
 
     std::vector<UserClosure *> user_closures_;
     std::unordered_map<std::string, unsigned> user_closure_map_;
 
+    // one per instruction of `code_`
+    std::vector<InlineCache> inline_caches_;
+
     // main scene of current virtual machine
     VMScene *main_;
     VMScene *current_scene_;
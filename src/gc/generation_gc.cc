@@ -1,41 +1,90 @@
 #include <nerangake/generation_gc.h>
 
 #include <assert.h>
+#include <stdint.h> // SIZE_MAX
 #include <string.h> // memcpy
 
 #include <algorithm>
 #include <stdexcept> // exception
+#include <thread>
 
 #include <nerangake/context.h>
+#include <nerangake/object/visitor.h>
 
 namespace nrk {
 namespace gc {
 
 static size_t Align4K(size_t size) { return size & ~0xFFF; }
 
-static uint32_t Align(uint32_t value) { return (value + 0x3) & ~0x3; }
+// Objects are 8 bytes aligned, so that parallel scavenge could claim their
+// header word atomically.
+static size_t Align(size_t value) { return (value + 0x7) & ~0x7; }
 
 static uint8_t *const Offset(uint8_t *const add, double factor, size_t length) {
     assert(factor < 1.0);
-    uint32_t size = Align(length * factor);
+    size_t size = Align(length * factor);
     return add + size;
 }
 
-GenerationGC::GenerationGC(size_t size)
+// Rates of pacing follow new samples at this weight.
+static double Decay(double average, double sample) {
+    return average * 0.7 + sample * 0.3;
+}
+
+GenerationGC::GenerationGC(
+    size_t size, size_t num_of_workers, double slice_budget_ms)
     : space_size_(Align4K(size))
     , start_(new uint8_t[space_size_])
     , survivor1_start_(Offset(start_, 0.2, space_size_))
     , survivor2_start_(Offset(start_, 0.3, space_size_))
     , old_start_(Offset(start_, 0.4, space_size_))
-    , end_(start_ + space_size_) {
+    , end_(start_ + space_size_)
+    , num_of_blocks_((end_ - old_start_) >> BLOCK_SHIFT)
+    , slice_budget_(slice_budget_ms * 1e6) {
     from_ = survivor1_start_;
     to_ = survivor2_start_;
     to_free_ = to_;
     new_free_ = start_;
     old_free_ = old_start_;
+    marking_ = false;
+    marker_done_ = false;
+    eden_marking_start_ = start_;
+    compaction_requested_ = false;
+    copy_out_room_ = 0;
+
+    size_t num_of_cards = ((end_ - old_start_) >> CARD_SHIFT) + 1;
+    cards_.assign(num_of_cards, CLEAN_CARD);
+    card_objects_.assign(num_of_cards, nullptr);
+
+    // The tail of old space shorter than a block is left unused.
+    line_marks_.assign(num_of_blocks_ * LINES_PER_BLOCK, 0);
+    live_epoch_ = marking_epoch_ = 1;
+    for (auto &bits : mark_bits_)
+        bits.assign(num_of_blocks_ * MARK_WORDS_PER_BLOCK, 0);
+    block_states_.assign(num_of_blocks_, FREE_BLOCK);
+    swept_.assign(num_of_blocks_, true);
+    next_block_ = 0;
+    available_ = num_of_blocks_ * BLOCK_SIZE;
+    marking_trigger_ = available_ / 2;
+
+    slice_limit_ = survivor1_start_;
+    marked_bytes_ = mark_work_ = 0;
+    sweep_cursor_ = 0;
+    mark_rate_ = 0.5;
+    sweep_rate_ = 4.0;
+    promotion_rate_ = 0.1;
+
+    if (num_of_workers > 1) {
+        for (size_t i = 0; i < num_of_workers; ++i)
+            workers_.emplace_back(new Worker);
+    }
 }
 
-GenerationGC::~GenerationGC() { delete[] start_; }
+GenerationGC::~GenerationGC() {
+    if (marker_.joinable()) marker_.join();
+    HeapObject::set_concurrent_marking(false);
+    delete[] start_;
+}
 
 void GenerationGC::AllocationFail() {
     throw std::runtime_error("run out of memory.");
@@ -53,20 +102,69 @@ void GenerationGC::ProcessRootObjects(
 
 void GenerationGC::WriteBarrier(
     HeapObject *obj, RawObject **field, HeapObject *new_obj) {
-    if (reinterpret_cast<uint8_t *>(obj) >= old_start_ &&
-        reinterpret_cast<uint8_t *>(new_obj) < old_start_ &&
-        record_set_.count(obj) == 0) {
-        record_set_.insert(obj);
+    // The marker thread may read it meanwhile, see `HeapObject::VisitSlot`.
+    RawObject *value = new_obj;
+    __atomic_store_n(field, value, __ATOMIC_RELAXED);
+    if (!IsYoung(obj) && IsYoung(new_obj)) DirtyCard(field);
+}
+
+void GenerationGC::WriteBarrierRange(
+    HeapObject *obj, RawObject **fields, size_t count) {
+    if (IsYoung(obj)) return;
+
+    for (size_t i = 0; i < count; ++i) {
+        RawObject *field = fields[i];
+        if (field->IsObject() && IsYoung(HeapObject::From(field)))
+            DirtyCard(&fields[i]);
+    }
+}
+
+/**
+ * Snapshot-at-the-beginning: an old object referenced when marking started
+ * stays marked, even if mutator moves its last reference into an object
+ * already scanned, since the overwritten reference is shaded here.
+ */
+void GenerationGC::PreWriteBarrier(
+    HeapObject *obj, RawObject **fields, size_t count) {
+    if (!marking_) return;
+
+    // Fields of objects allocated since marking started may not be
+    // initialized yet, and they aren't part of the snapshot anyway.
+    uint8_t *address = reinterpret_cast<uint8_t *>(obj);
+    if (address >= eden_marking_start_ && address < survivor1_start_) return;
+
+    for (size_t i = 0; i < count; ++i) {
+        RawObject *field = fields[i];
+        if (field != nullptr && field->IsObject())
+            Shade(HeapObject::From(field));
     }
-    *field = new_obj;
+}
+
+void GenerationGC::Shade(HeapObject *obj) {
+    if (IsYoung(obj) || !MarkObject(obj)) return;
+
+    satb_buffer_.push_back(obj);
+    if (satb_buffer_.size() >= SATB_BUFFER_SIZE) FlushSatbBuffer();
+}
+
+void GenerationGC::FlushSatbBuffer() {
+    std::lock_guard<std::mutex> lock(gray_mutex_);
+    gray_queue_.insert(
+        gray_queue_.end(), satb_buffer_.begin(), satb_buffer_.end());
+    satb_buffer_.clear();
 }
 
 GenerationGC::HeapObject *GenerationGC::AllocateInNewSpace(size_t size) {
-    if (new_free_ + size >= survivor1_start_) {
-        MinorGC();
-        if (new_free_ + size >= survivor1_start_) {
-            // TODO: promote it into old space.
-            AllocationFail();
+    size = Align(size);
+    if (new_free_ + size >= slice_limit_) {
+        if (new_free_ + size < survivor1_start_) {
+            RunSlice();
+        } else {
+            MinorGC();
+            if (new_free_ + size >= survivor1_start_) {
+                // TODO: promote it into old space.
+                AllocationFail();
+            }
         }
     }
 
@@ -82,161 +180,1377 @@ GenerationGC::HeapObject *GenerationGC::AllocateInNewSpace(size_t size) {
 }
 
 void GenerationGC::MinorGC() {
+    // Every survivor may be promoted, make sure that old space can hold them
+    // before any object is moved.
+    if (available_ < young_size()) MajorGC();
+
+    const size_t eden = new_free_ - start_;
+    const size_t available = available_;
+    copy_out_room_.store(
+        available > young_size() ? available - young_size() : 0,
+        std::memory_order_relaxed);
     to_free_ = to_;
+    if (workers_.empty())
+        Scavenge();
+    else
+        ParallelScavenge();
+    const size_t promoted = available - available_;
+    if (eden > 0) {
+        promotion_rate_ =
+            Decay(promotion_rate_, static_cast<double>(promoted) / eden);
+    }
+    // Promoted objects are shaded, incremental marking traces them too.
+    if (marking_) mark_work_ += promoted;
 
-    auto cb = std::bind(
-        &GenerationGC::CopyIntoAnotherSpace, this, std::placeholders::_1);
+    new_free_ = start_;
+    std::swap(to_, from_);
 
-    ProcessRootObjects(cb);
-    ProcessTransboundaryReference();
+    if (marking_) {
+        // Eden is empty, objects allocated from now on are all new.
+        eden_marking_start_ = start_;
+        if (marker_done_.load(std::memory_order_acquire)) FinishMajorGC();
+    } else if (ShouldStartMarking()) {
+        StartMarking();
+    }
+    ScheduleSlice();
+}
 
-    std::swap(to_, from_);
+/**
+ * Cheney's copying: roots and old objects of dirty cards are evacuated
+ * first, then the objects copied into to space are scanned linearly from
+ * `scan` to `to_free_`, evacuating their children behind them, until both
+ * meet. Promoted objects are scanned the same way from `promoted_`.
+ * Traversal is breadth first and never recurses, so deep object graphs can't
+ * overflow the C++ stack.
+ */
+void GenerationGC::Scavenge() {
+    auto copy = [this](HeapObject *child) {
+        return CopyIntoAnotherSpace(child);
+    };
+
+    // Objects of dirty cards are collected before anything is promoted into
+    // the holes among them, which would be scanned twice otherwise: once
+    // here and once from `promoted_`, copying their children again.
+    std::vector<HeapObject *> dirty;
+    ProcessDirtyCards([&dirty](HeapObject *obj) { dirty.push_back(obj); });
+
+    promoted_.clear();
+    ProcessRootObjects(copy);
+    ProcessTemporaryRoots();
+    for (HeapObject *obj : dirty) {
+        if (ScanOldObject(obj, copy)) DirtyCard(obj);
+    }
+
+    uint8_t *scan = to_;
+    size_t promoted_scan = 0;
+    while (scan < to_free_ || promoted_scan < promoted_.size()) {
+        while (scan < to_free_) {
+            HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
+            object::VisitPointers(obj, copy);
+            scan += obj->size();
+        }
+        while (promoted_scan < promoted_.size()) {
+            HeapObject *obj = promoted_[promoted_scan++];
+            if (ScanOldObject(obj, copy)) DirtyCard(obj);
+        }
+    }
+
+    // Promoted objects may be the only holders of old objects of the
+    // snapshot, so they are traced by the marker.
+    if (marking_) {
+        for (HeapObject *obj : promoted_) Shade(obj);
+        FlushSatbBuffer();
+    }
 }
 
-GenerationGC::HeapObject *GenerationGC::CopyIntoAnotherSpace(HeapObject *obj) {
-    // CopyIntoAnotherSpace is effective only for
-    // objects within the Cenozoic region.
-    if (reinterpret_cast<uint8_t *>(obj) >= old_start_) return obj;
-
-    // TODO: run out of `to` memory.
-    if (!obj->forwarded()) {
-        const uint8_t age = obj->age();
-        if (age < MAX_AGE) {
-            obj->set_age(age + 1);
-            memcpy(to_free_, obj, obj->size());
-            obj->set_forwarded(true);
-            obj->set_forwarding(reinterpret_cast<uintptr_t>(to_free_));
-
-            to_free_ += obj->size();
-            HeapObject::Children(
-                obj,
-                std::bind(
-                    &GenerationGC::CopyIntoAnotherSpace, this,
-                    std::placeholders::_1));
-        } else {
-            Promote(obj);
+/**
+ * Evacuate the children of `obj` in old space with `copy`.
+ *
+ * @return  whether `obj` still references young objects.
+ */
+template <typename Copy>
+bool GenerationGC::ScanOldObject(HeapObject *obj, Copy &copy) {
+    bool young = false;
+    object::VisitPointers(obj, [this, &copy, &young](HeapObject *child) {
+        child = copy(child);
+        young = young || IsYoung(child);
+        return child;
+    });
+    return young;
+}
+
+/**
+ * Parallel scavenge: roots are evacuated by the calling thread and objects of
+ * dirty cards are dealt to the workers, then workers scan objects from their
+ * own deques and steal from others when run out, until all of them are idle.
+ *
+ * Workers copy objects into their local allocation buffers, and promote them
+ * into holes of old space of their own. An object is claimed by a CAS on its
+ * header before it is copied (see `ParallelCopy`).
+ */
+void GenerationGC::ParallelScavenge() {
+    for (auto &worker : workers_) {
+        worker->lab_top = worker->lab_end = nullptr;
+        worker->copied = 0;
+    }
+
+    // Dirty cards are dealt before roots promote anything into the holes
+    // among them, so that no object is scanned by two workers.
+    size_t next = 0;
+    ProcessDirtyCards([this, &next](HeapObject *obj) {
+        workers_[next++ % workers_.size()]->deque.Push(obj);
+    });
+
+    Worker *self = workers_[0].get();
+    auto copy = [this, self](HeapObject *obj) {
+        return ParallelCopy(self, obj);
+    };
+    ProcessRootObjects(copy);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) *slot = copy(*slot);
+    }
+
+    std::atomic<size_t> active(workers_.size());
+    std::vector<std::thread> threads;
+    for (size_t id = 1; id < workers_.size(); ++id)
+        threads.emplace_back(&GenerationGC::Work, this, id, &active);
+    Work(0, &active);
+    for (std::thread &thread : threads) thread.join();
+
+    if (marking_) {
+        for (auto &worker : workers_) {
+            for (HeapObject *obj : worker->promoted) Shade(obj);
+            worker->promoted.clear();
         }
+        FlushSatbBuffer();
     }
-    return reinterpret_cast<HeapObject *>(obj->forwarding());
 }
 
-void GenerationGC::Promote(HeapObject *obj) {
-    uint8_t *address = AllocateInOldSpace(obj->size());
-    if (address == nullptr) {
-        MajorGC();
-        address = AllocateInOldSpace(obj->size());
+void GenerationGC::Work(size_t id, std::atomic<size_t> *active) {
+    Worker *worker = workers_[id].get();
+    auto copy = [this, worker](HeapObject *child) {
+        return ParallelCopy(worker, child);
+    };
+
+    HeapObject *obj;
+    for (;;) {
+        if (worker->deque.Pop(&obj) || Steal(id, &obj)) {
+            if (IsYoung(obj))
+                object::VisitPointers(obj, copy);
+            else if (ScanOldObject(obj, copy))
+                DirtyCard(obj);
+            continue;
+        }
+
+        // Only busy workers make new work, so it is over once none is busy.
+        active->fetch_sub(1);
+        while (!HasWork()) {
+            if (active->load() == 0) return;
+            std::this_thread::yield();
+        }
+        active->fetch_add(1);
+    }
+}
+
+bool GenerationGC::Steal(size_t id, HeapObject **obj) {
+    using Deque = WorkStealingDeque<HeapObject *>;
+
+    const size_t n = workers_.size();
+    bool retry = true;
+    while (retry) {
+        retry = false;
+        for (size_t i = 1; i < n; ++i) {
+            Deque::StealResult result =
+                workers_[(id + i) % n]->deque.Steal(obj);
+            if (result == Deque::kStolen) return true;
+            if (result == Deque::kAbort) retry = true;
+        }
+    }
+    return false;
+}
+
+bool GenerationGC::HasWork() const {
+    for (const auto &worker : workers_) {
+        if (!worker->deque.empty()) return true;
+    }
+    return false;
+}
+
+/**
+ * The parallel `CopyIntoAnotherSpace`. The first header word (age, forwarded,
+ * size and type) is claimed by a CAS marking it `BUSY_HEADER`, the winner
+ * copies the object and publishes the forwarding pointer with a release
+ * store, while losers wait for it. It relies on little endian layout.
+ */
+GenerationGC::HeapObject *GenerationGC::ParallelCopy(
+    Worker *worker, HeapObject *obj) {
+    if (!IsYoung(obj)) return obj;
+
+    uint64_t *word = reinterpret_cast<uint64_t *>(obj);
+    uint64_t header = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    for (;;) {
+        if ((header & 0xFF) == BUSY_HEADER) {
+            std::this_thread::yield();
+            header = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        if (header & 0x1)
+            return reinterpret_cast<HeapObject *>(obj->forwarding());
+
+        uint64_t busy = header | BUSY_HEADER;
+        if (__atomic_compare_exchange_n(
+                word, &header, busy, false, __ATOMIC_ACQUIRE,
+                __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+
+    const uint8_t age = static_cast<uint8_t>(header & 0xFF) >> 1;
+    bool copy_out = ShouldCopyOut(obj);
+    size_t size = EvacuatedSize(obj, copy_out);
+    uint8_t *address = nullptr;
+    if (age < MAX_AGE) address = AllocateInToSpace(worker, size);
+
+    HeapObject *copy;
+    if (address != nullptr) {
+        worker->copied += obj->size();
+        copy = Evacuate(obj, address, copy_out);
+        copy->set_age(age + 1);
+    } else {
+        // `MinorGC` has reserved old space for all survivors as they are.
+        copy_out_room_.fetch_add(worker->copied, std::memory_order_relaxed);
+        worker->copied = 0;
+        if (copy_out && !ReserveCopyOut(obj)) {
+            copy_out = false;
+            size = EvacuatedSize(obj, false);
+        }
+        address = AllocateInOldSpace(&worker->promotion, size);
         if (address == nullptr) AllocationFail();
+        copy = Evacuate(obj, address, copy_out);
+        copy->set_age(age);
+        if (marking_) worker->promoted.push_back(copy);
     }
+    copy->set_forwarded(false);
+    worker->deque.Push(copy);
 
+    // The forwarding pointer spans bytes [4, 12), write its high half beyond
+    // the header word first, then publish the word with its low half.
+    uintptr_t forwarding = reinterpret_cast<uintptr_t>(copy);
+    uint32_t high = static_cast<uint32_t>(forwarding >> 32);
+    memcpy(reinterpret_cast<uint8_t *>(obj) + 8, &high, sizeof(high));
+    uint64_t forwarded = (header & 0xFFFFFF00) | 0x1 |
+        (static_cast<uint64_t>(forwarding & 0xFFFFFFFF) << 32);
+    __atomic_store_n(word, forwarded, __ATOMIC_RELEASE);
+    return copy;
+}
+
+uint8_t *GenerationGC::AllocateInToSpace(Worker *worker, size_t size) {
+    if (size <= static_cast<size_t>(worker->lab_end - worker->lab_top)) {
+        uint8_t *result = worker->lab_top;
+        worker->lab_top += size;
+        return result;
+    }
+
+    // The rest of the buffer is wasted, to space is never parsed after a
+    // parallel scavenge.
+    copy_out_room_.fetch_add(worker->copied, std::memory_order_relaxed);
+    worker->copied = 0;
+    if (size > LAB_SIZE / 4) return BumpToSpace(size);
+
+    uint8_t *lab = BumpToSpace(LAB_SIZE);
+    if (lab == nullptr) return BumpToSpace(size);
+    worker->lab_top = lab + size;
+    worker->lab_end = lab + LAB_SIZE;
+    return lab;
+}
+
+uint8_t *GenerationGC::BumpToSpace(size_t size) {
+    uint8_t *const end = to_end();
+    uint8_t *result = __atomic_load_n(&to_free_, __ATOMIC_RELAXED);
+    do {
+        if (static_cast<size_t>(end - result) < size) return nullptr;
+    } while (!__atomic_compare_exchange_n(
+        &to_free_, &result, result + size, true, __ATOMIC_RELAXED,
+        __ATOMIC_RELAXED));
+    return result;
+}
+
+void GenerationGC::ProcessTemporaryRoots() {
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) *slot = CopyIntoAnotherSpace(*slot);
+    }
+}
+
+/**
+ * A surviving tiny slice is copied out as a flat `String`, so that it does
+ * not keep its large parent alive. Whether it is, is decided once per object
+ * and passed along, since promoting may decline it.
+ */
+bool GenerationGC::ShouldCopyOut(HeapObject *obj) const {
+    return obj->IsStringSlice() &&
+        HeapObject::Cast<StringSlice>(obj)->ShouldCopyOut();
+}
+
+size_t GenerationGC::EvacuatedSize(HeapObject *obj, bool copy_out) {
+    if (copy_out) {
+        StringSlice *slice = HeapObject::Cast<StringSlice>(obj);
+        return Align(slice->CopyOutSize());
+    }
+    return obj->size();
+}
+
+GenerationGC::HeapObject *GenerationGC::Evacuate(
+    HeapObject *obj, uint8_t *address, bool copy_out) {
     RawObject *raw = RawObject::From(address);
-    HeapObject *new_obj = HeapObject::From(raw);
-    memcpy(new_obj, obj, obj->size());
-    obj->set_forwarding(reinterpret_cast<uintptr_t>(new_obj));
+    HeapObject *target = HeapObject::From(raw);
+
+    if (copy_out) {
+        StringSlice *slice = HeapObject::Cast<StringSlice>(obj);
+        size_t size = EvacuatedSize(obj, true);
+        target->set_age(obj->age());
+        target->set_forwarded(false);
+        target->set_size(static_cast<uint32_t>(size));
+        slice->CopyOut(target);
+        return target;
+    }
+
+    memcpy(target, obj, obj->size());
+    return target;
+}
+
+GenerationGC::HeapObject *GenerationGC::CopyIntoAnotherSpace(HeapObject *obj) {
+    // CopyIntoAnotherSpace is effective only for
+    // objects within the Cenozoic region.
+    if (!IsYoung(obj)) return obj;
+
+    if (obj->forwarded())
+        return reinterpret_cast<HeapObject *>(obj->forwarding());
+
+    // Only copy the object here, its children are evacuated when `Scavenge`
+    // reaches the copy.
+    const uint8_t age = obj->age();
+    const bool copy_out = ShouldCopyOut(obj);
+    HeapObject *copy;
+    if (age < MAX_AGE &&
+        to_free_ + EvacuatedSize(obj, copy_out) <= to_end()) {
+        copy_out_room_.fetch_add(obj->size(), std::memory_order_relaxed);
+        copy = Evacuate(obj, to_free_, copy_out);
+        copy->set_age(age + 1);
+        to_free_ += copy->size();
+    } else {
+        copy = Promote(obj, copy_out);
+    }
+
     obj->set_forwarded(true);
+    obj->set_forwarding(reinterpret_cast<uintptr_t>(copy));
+    return copy;
+}
+
+GenerationGC::HeapObject *GenerationGC::Promote(
+    HeapObject *obj, bool copy_out) {
+    // `MinorGC` has reserved old space for all survivors as they are.
+    if (copy_out && !ReserveCopyOut(obj)) copy_out = false;
+    uint8_t *address = AllocateInOldSpace(EvacuatedSize(obj, copy_out));
+    if (address == nullptr) AllocationFail();
+
+    HeapObject *new_obj = Evacuate(obj, address, copy_out);
+    promoted_.push_back(new_obj);
+    return new_obj;
+}
+
+/**
+ * A slice copied out grows up to a quarter of its parent, which the
+ * reservation of `MinorGC` doesn't cover. Take the growth from the old space
+ * left beyond what may still be promoted, or the slice is promoted as it is.
+ */
+bool GenerationGC::ReserveCopyOut(HeapObject *obj) {
+    const size_t size = EvacuatedSize(obj, true);
+    const size_t growth = size > obj->size() ? size - obj->size() : 0;
+    size_t room = copy_out_room_.load(std::memory_order_relaxed);
+    do {
+        if (room < growth) return false;
+    } while (!copy_out_room_.compare_exchange_weak(
+        room, room - growth, std::memory_order_relaxed));
+    return true;
+}
+
+/**
+ * Clean dirty cards and pass each object overlapping them to `process`,
+ * once, which scans it whole and dirties the card of its header again if it
+ * still references young objects.
+ */
+template <typename Process>
+void GenerationGC::ProcessDirtyCards(Process &&process) {
+    // Objects promoted from now on are scanned along with copies.
+    uint8_t *const limit = old_free_;
+    uint8_t *scanned = old_start_;
+    for (size_t card = 0; CardStart(card) < limit; ++card) {
+        if (cards_[card] == CLEAN_CARD) continue;
+        cards_[card] = CLEAN_CARD;
 
-    bool need_insert = false;
-    HeapObject::Children(
-        new_obj,
-        [&need_insert, this, new_obj](HeapObject *child) -> HeapObject * {
-            child = CopyIntoAnotherSpace(child);
-            if (reinterpret_cast<uint8_t *>(child) < old_start_) {
-                need_insert = true;
+        uint8_t *scan = reinterpret_cast<uint8_t *>(card_objects_[card]);
+        scan = std::max(scan, scanned);
+        uint8_t *card_end = std::min(CardStart(card + 1), limit);
+        while (scan < card_end) {
+            HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
+            scan += obj->size();
+            // Free space, which workers may promote objects into.
+            if (obj->IsFiller()) continue;
+            // Dead objects are left to lazy sweeping, which may overwrite
+            // them meanwhile.
+            if (!swept_[BlockOf(obj)] && !IsMarked(obj, live_epoch_)) continue;
+            process(obj);
+        }
+        scanned = scan;
+    }
+}
+
+void GenerationGC::NoteCardObjects(HeapObject *obj, uint8_t *end) {
+    uint8_t *start = reinterpret_cast<uint8_t *>(obj);
+    size_t card = CardOf(start + CARD_SIZE - 1);
+    for (; CardStart(card) < end; ++card) card_objects_[card] = obj;
+}
+
+/**
+ * Bump `hole`, or else find another hole for small objects, a free block for
+ * the ones larger than a line and a run of free blocks for large ones. The
+ * rest of a hole is always a filler, so that old space stays parsable for
+ * card scanning and sweeping.
+ */
+uint8_t *GenerationGC::AllocateInOldSpace(Hole *hole, size_t size) {
+    size = Align(size);
+
+    uint8_t *result;
+    if (size <= static_cast<size_t>(hole->end - hole->top)) {
+        result = BumpHole(hole, size);
+    } else {
+        // Workers of parallel scavenge promote objects at the same time.
+        std::lock_guard<std::mutex> lock(old_mutex_);
+        if (size >= LARGE_OBJECT_SIZE) {
+            result = AllocateLarge(size);
+        } else {
+            if (size > LINE_SIZE &&
+                (size <= static_cast<size_t>(overflow_.end - overflow_.top) ||
+                 TakeFreeBlock(&overflow_))) {
+                hole = &overflow_;
             }
-            return child;
-        });
-    if (need_insert) record_set_.insert(new_obj);
-}
-
-void GenerationGC::ProcessTransboundaryReference() {
-    for (auto it = record_set_.begin(); it != record_set_.end();) {
-        HeapObject *obj = *it;
-        bool result = false;
-        HeapObject::Children(
-            obj, [&result, this](HeapObject *child) -> HeapObject * {
-                child = CopyIntoAnotherSpace(child);
-                result =
-                    result || old_start_ > reinterpret_cast<uint8_t *>(child);
-                return child;
-            });
-        if (!result)
-            it = record_set_.erase(it);
-        else
-            it++;
+            while (size > static_cast<size_t>(hole->end - hole->top)) {
+                if (!NextHole(hole)) return nullptr;
+            }
+            result = BumpHole(hole, size);
+        }
+        if (result == nullptr) return nullptr;
+    }
+
+    HeapObject *object = reinterpret_cast<HeapObject *>(result);
+    object->set_age(0u);
+    object->set_forwarded(false);
+    object->set_size(static_cast<uint32_t>(size));
+    NoteCardObjects(object, result + size);
+    return result;
+}
+
+uint8_t *GenerationGC::BumpHole(Hole *hole, size_t size) {
+    uint8_t *result = hole->top;
+    hole->top += size;
+    if (hole->top < hole->end)
+        HeapObject::CreateFiller(hole->top, hole->end - hole->top);
+    return result;
+}
+
+/**
+ * Move `hole` to the next run of free lines, of its block or of the next one
+ * not taken yet. Each run starts with a filler, see `FormatFree`.
+ */
+bool GenerationGC::NextHole(Hole *hole) {
+    for (;;) {
+        if (hole->end != nullptr) {
+            size_t line = LineOf(hole->end);
+            const size_t end = LineOf(hole->block_end);
+            while (line < end && !IsFreeLine(line)) ++line;
+            const size_t first = line;
+            while (line < end && IsFreeLine(line)) ++line;
+            if (first < line) {
+                hole->top = LineStart(first);
+                hole->end = LineStart(line);
+                return true;
+            }
+        }
+
+        while (next_block_ < num_of_blocks_ &&
+               block_states_[next_block_] != FREE_BLOCK &&
+               block_states_[next_block_] != RECYCLABLE_BLOCK) {
+            ++next_block_;
+        }
+        if (next_block_ == num_of_blocks_) {
+            *hole = Hole();
+            return false;
+        }
+
+        size_t block = next_block_++;
+        TakeBlock(block);
+        hole->top = hole->end = BlockStart(block);
+        hole->block_end = BlockStart(block + 1);
+    }
+}
+
+bool GenerationGC::TakeFreeBlock(Hole *hole) {
+    size_t block = next_block_;
+    while (block < num_of_blocks_ && block_states_[block] != FREE_BLOCK)
+        ++block;
+    if (block == num_of_blocks_) return false;
+
+    TakeBlock(block);
+    hole->top = BlockStart(block);
+    hole->end = hole->block_end = BlockStart(block + 1);
+    return true;
+}
+
+uint8_t *GenerationGC::AllocateLarge(size_t size) {
+    const size_t count = (size + BLOCK_SIZE - 1) >> BLOCK_SHIFT;
+    size_t first = next_block_, run = 0;
+    for (size_t block = next_block_; block < num_of_blocks_; ++block) {
+        if (block_states_[block] != FREE_BLOCK) {
+            run = 0;
+        } else if (run++ == 0) {
+            first = block;
+        }
+        if (run == count) break;
+    }
+    if (run < count) return nullptr;
+
+    for (size_t block = first; block < first + count; ++block)
+        TakeBlock(block);
+    uint8_t *result = BlockStart(first);
+    uint8_t *end = BlockStart(first + count);
+    if (result + size < end) {
+        HeapObject *filler =
+            HeapObject::CreateFiller(result + size, end - result - size);
+        NoteCardObjects(filler, end);
+    }
+    return result;
+}
+
+/**
+ * Its free lines are no longer available to others until the next major GC.
+ * It is swept first if not yet, and blocks are taken in address order, an
+ * untouched one is formatted as a single filler.
+ */
+void GenerationGC::TakeBlock(size_t block) {
+    available_ -= FreeLines(block) * LINE_SIZE;
+    block_states_[block] = UNAVAILABLE_BLOCK;
+    if (!swept_[block]) SweepBlock(block);
+
+    uint8_t *end = BlockStart(block + 1);
+    if (old_free_ < end) {
+        assert(old_free_ == BlockStart(block));
+        HeapObject *filler = HeapObject::CreateFiller(old_free_, BLOCK_SIZE);
+        NoteCardObjects(filler, end);
+        old_free_ = end;
+    }
+}
+
+size_t GenerationGC::FreeLines(size_t block) const {
+    size_t count = 0;
+    const size_t end = (block + 1) * LINES_PER_BLOCK;
+    for (size_t line = block * LINES_PER_BLOCK; line < end; ++line) {
+        if (IsFreeLine(line)) ++count;
     }
+    return count;
 }
 
-uint8_t *GenerationGC::AllocateInOldSpace(size_t size) {
-    if (old_free_ + size >= end_) { return nullptr; }
-    uint8_t *result = old_free_;
-    old_free_ += size;
+void GenerationGC::ResetHoles() {
+    hole_ = overflow_ = Hole();
+    for (auto &worker : workers_) worker->promotion = Hole();
+}
+
+uint8_t *GenerationGC::AllocateStatic(size_t size) {
+    uint8_t *result = AllocateInOldSpace(size);
+    if (result == nullptr || !marking_) return result;
+
+    // Allocated black. Its fields are cleared, so that its pre-write barrier
+    // never reads garbage.
+    HeapObject *object = reinterpret_cast<HeapObject *>(result);
+    memset(result + sizeof(uint32_t), 0, object->size() - sizeof(uint32_t));
+    MarkObject(object);
     return result;
 }
 
+/**
+ * Major GC marks old space mostly concurrently, in tri-color: marked objects
+ * in a stack are gray, the others marked are black.
+ *
+ * - Initial mark, a pause at the end of a minor GC: old objects referenced
+ *   by roots and by the young objects they reach are shaded, then the
+ *   marker thread is started.
+ * - Concurrent mark: the marker traces old objects. Mutator keeps running,
+ *   its pre-write barrier and minor GCs shade the overwritten references
+ *   and the promoted objects.
+ * - Remark, a pause once the marker is done: the rest is shaded, the young
+ *   objects reachable from roots and old objects are traced once more.
+ *
+ * Then blocks with few lines alive are evacuated, and the others are swept
+ * lazily by the allocator: free lines are reused in place, and no object
+ * outside of the evacuated blocks moves. Marks are kept in a bitmap aside,
+ * so neither marking nor sweeping writes to live objects. Pauses trace
+ * young objects and what is left over by the marker, not the whole of old
+ * space: every old object of the snapshot that mutator keeps is either
+ * marked or reported by the barrier.
+ *
+ * Old space too fragmented for evacuation is compacted instead, see
+ * `Compact`.
+ *
+ * With a slice budget there is no marker thread: concurrent mark and lazy
+ * sweeping are done incrementally by mutator, see `RunSlice`.
+ */
 void GenerationGC::MajorGC() {
-    ForwardingMap forwarding_map;
+    if (!marking_) StartMarking();
+    FinishMajorGC();
+}
 
-    // mark phase
-    auto cb = std::bind(&GenerationGC::Mark, this, std::placeholders::_1);
+/**
+ * Incremental marking also starts once old space in use takes as many slices
+ * to mark as the eden allocations left before it must be done allow, at
+ * `PACED_SLICES_PER_EDEN`: half of old space may be too late for it.
+ */
+bool GenerationGC::ShouldStartMarking() const {
+    if (available_ <= marking_trigger_) return true;
+    if (slice_budget_ <= 0) return false;
 
-    ProcessRootObjects(cb);
-    RecordForwarding(forwarding_map);
-    ResetReferences(forwarding_map);
-    Compact(forwarding_map);
+    const size_t work = num_of_blocks_ * BLOCK_SIZE - available_;
+    const double slices = work / (mark_rate_ * slice_budget_);
+    const double allocation =
+        slices * (survivor1_start_ - start_) / PACED_SLICES_PER_EDEN;
+    return available_ <= young_size() + allocation * promotion_rate_;
 }
 
-GenerationGC::HeapObject *GenerationGC::Mark(HeapObject *obj) {
-    if (reinterpret_cast<uint8_t *>(obj) >= old_start_) {
-        obj->set_forwarded(true);
+void GenerationGC::StartMarking() {
+    assert(!marking_ && "marking is in progress");
+
+    marking_ = true;
+    HeapObject::set_concurrent_marking(true);
+    marker_done_.store(false, std::memory_order_relaxed);
+    eden_marking_start_ = new_free_;
+    // Epochs alternate in parity, the bitmap of the next one is clear.
+    marking_epoch_ = live_epoch_ == UINT8_MAX ? 2 : live_epoch_ + 1;
+
+    // Young objects reachable from roots are traced in the pause, they
+    // could be moved by minor GCs under the marker.
+    std::vector<HeapObject *> gray, young;
+    auto shade = [this, &gray, &young](HeapObject *obj) {
+        if (!IsYoung(obj)) {
+            if (MarkObject(obj)) gray.push_back(obj);
+        } else if (!obj->forwarded()) {
+            obj->set_forwarded(true);
+            young_live_.push_back(obj);
+            young.push_back(obj);
+        }
+        return obj;
+    };
+
+    ProcessRootObjects(shade);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) shade(*slot);
+    }
+    while (!young.empty()) {
+        HeapObject *obj = young.back();
+        young.pop_back();
+        object::VisitPointers(obj, shade);
+    }
+
+    for (HeapObject *obj : young_live_) obj->set_forwarded(false);
+    young_live_.clear();
+
+    if (slice_budget_ > 0) {
+        mark_stack_ = std::move(gray);
+        marked_bytes_ = 0;
+        mark_work_ = num_of_blocks_ * BLOCK_SIZE - available_;
+        return;
     }
-    HeapObject::Children(
-        obj, std::bind(&GenerationGC::Mark, this, std::placeholders::_1));
-    return obj;
+    marker_ = std::thread(&GenerationGC::ConcurrentMark, this, std::move(gray));
 }
 
-void GenerationGC::RecordForwarding(ForwardingMap &map) {
-    uint8_t *free = old_start_, *scan = old_start_;
-    while (scan < end_) {
-        HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
-        while (!obj->forwarded()) {
-            scan += obj->size();
-            obj = reinterpret_cast<HeapObject *>(scan);
+/**
+ * The marker thread. Only old objects are traced, a reference read while a
+ * minor GC updates it is either the young object or its copy, which is
+ * shaded when promoted. Slots are never written, see `VisitSlot`.
+ */
+void GenerationGC::ConcurrentMark(std::vector<HeapObject *> stack) {
+    auto shade = [this, &stack](HeapObject *child) {
+        if (!IsYoung(child) && MarkObject(child)) stack.push_back(child);
+        return child;
+    };
+
+    for (;;) {
+        while (!stack.empty()) {
+            HeapObject *obj = stack.back();
+            stack.pop_back();
+            object::VisitPointers(obj, shade);
         }
 
-        HeapObject *new_obj = reinterpret_cast<HeapObject *>(free);
-        map.insert(ForwardingMap::value_type(obj, new_obj));
-        free += obj->size();
-        scan += obj->size();
+        // Objects shaded later are left to the remark.
+        std::lock_guard<std::mutex> lock(gray_mutex_);
+        if (gray_queue_.empty()) {
+            marker_done_.store(true, std::memory_order_release);
+            return;
+        }
+        stack.swap(gray_queue_);
+    }
+}
+
+/**
+ * Incremental mode: allocation runs a slice of marking, or of sweeping once
+ * marking is done, each time eden reaches `slice_limit_`. A slice stops at
+ * its budget, then `ScheduleSlice` places the next one. Pauses are those of
+ * minor GCs and of the remark, plus slices, instead of a marker thread
+ * competing with mutator for the cores.
+ */
+void GenerationGC::RunSlice() {
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start +
+        std::chrono::nanoseconds(static_cast<int64_t>(slice_budget_));
+
+    const bool marking = marking_;
+    const size_t work = marking ? MarkSlice(deadline) : SweepSlice(deadline);
+    const double elapsed = std::chrono::duration<double, std::nano>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    if (work > 0 && elapsed > 0) {
+        double &rate = marking ? mark_rate_ : sweep_rate_;
+        rate = Decay(rate, work / elapsed);
     }
+    ScheduleSlice();
 }
 
-void GenerationGC::ResetReferences(ForwardingMap &map) {
-    RootObjectHolderInterface::Callback reseter =
-        [this, &map, &reseter](HeapObject *obj) -> HeapObject * {
-        if (map.count(obj)) { obj = map[obj]; }
-        HeapObject::Children(obj, reseter);
+/**
+ * Trace gray objects until the deadline, as the marker thread does. Those
+ * shaded by mutator are taken from its buffer as well, there is no other
+ * thread to hand them to.
+ *
+ * @return  bytes of the objects scanned.
+ */
+size_t GenerationGC::MarkSlice(
+    std::chrono::steady_clock::time_point deadline) {
+    auto shade = [this](HeapObject *child) {
+        if (!IsYoung(child) && MarkObject(child)) mark_stack_.push_back(child);
+        return child;
+    };
+
+    size_t scanned = 0;
+    for (size_t count = 0;; ++count) {
+        if (mark_stack_.empty()) {
+            FlushSatbBuffer();
+            mark_stack_.swap(gray_queue_);
+            if (mark_stack_.empty()) {
+                // The remark runs at the next minor GC.
+                marker_done_.store(true, std::memory_order_relaxed);
+                break;
+            }
+        }
+        if (count % SLICE_CHECK_INTERVAL == 0 &&
+            std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+
+        HeapObject *obj = mark_stack_.back();
+        mark_stack_.pop_back();
+        object::VisitPointers(obj, shade);
+        scanned += obj->size();
+    }
+    marked_bytes_ += scanned;
+    return scanned;
+}
+
+/**
+ * Sweep the blocks left by the last major GC until the deadline, so that the
+ * allocator finds them swept. Only the blocks it may take are: the others
+ * hold large objects alive, see `SweepBlock`.
+ *
+ * @return  bytes of the blocks swept.
+ */
+size_t GenerationGC::SweepSlice(
+    std::chrono::steady_clock::time_point deadline) {
+    const size_t used = BlockOf(old_free_);
+    size_t swept = 0;
+    while (sweep_cursor_ < used &&
+           std::chrono::steady_clock::now() < deadline) {
+        size_t block = sweep_cursor_++;
+        if (swept_[block] || (block_states_[block] != FREE_BLOCK &&
+                              block_states_[block] != RECYCLABLE_BLOCK)) {
+            continue;
+        }
+        SweepBlock(block);
+        swept += BLOCK_SIZE;
+    }
+    return swept;
+}
+
+/**
+ * Pacing: the work left is spread over the eden allocations that old space
+ * can take before it must be done, marking before old space can't hold the
+ * survivors of a minor GC, sweeping before the next marking starts. Eden
+ * allocations fill old space at the promotion rate, and a slice does its
+ * budget of work at the rate measured, which gives the eden bytes between
+ * two slices. One runs every half of eden at least, so that work goes on
+ * between minor GCs however much headroom is left.
+ */
+void GenerationGC::ScheduleSlice() {
+    slice_limit_ = survivor1_start_;
+    if (slice_budget_ <= 0) return;
+
+    size_t remaining, deadline;
+    double rate;
+    if (marking_) {
+        if (marker_done_.load(std::memory_order_relaxed)) return;
+        remaining = mark_work_ > marked_bytes_ ? mark_work_ - marked_bytes_
+                                               : BLOCK_SIZE;
+        deadline = young_size();
+        rate = mark_rate_;
+    } else {
+        const size_t used = BlockOf(old_free_);
+        if (sweep_cursor_ >= used) return;
+        remaining = (used - sweep_cursor_) * BLOCK_SIZE;
+        deadline = marking_trigger_;
+        rate = sweep_rate_;
+    }
+
+    const size_t headroom = available_ > deadline ? available_ - deadline : 0;
+    const double allocation = headroom / std::max(promotion_rate_, 0.01);
+    const double step = allocation * (rate * slice_budget_) / remaining;
+    const size_t eden = survivor1_start_ - start_;
+    const size_t min_step = eden / MAX_SLICES_PER_EDEN;
+    const size_t max_step = eden / 2;
+    size_t bytes = step < max_step ? static_cast<size_t>(step) : max_step;
+    bytes = Align(std::max(bytes, min_step));
+    if (bytes < static_cast<size_t>(survivor1_start_ - new_free_))
+        slice_limit_ = new_free_ + bytes;
+}
+
+void GenerationGC::FinishMajorGC() {
+    assert(marking_ && "marking isn't started");
+
+    if (marker_.joinable()) marker_.join();
+    std::vector<HeapObject *> stack;
+    stack.swap(gray_queue_);
+    stack.insert(stack.end(), mark_stack_.begin(), mark_stack_.end());
+    mark_stack_.clear();
+    stack.insert(stack.end(), satb_buffer_.begin(), satb_buffer_.end());
+    satb_buffer_.clear();
+
+    auto shade = [this, &stack](HeapObject *obj) {
+        if (!IsYoung(obj)) {
+            if (MarkObject(obj)) stack.push_back(obj);
+        } else if (!obj->forwarded()) {
+            obj->set_forwarded(true);
+            young_live_.push_back(obj);
+            stack.push_back(obj);
+        }
         return obj;
     };
-    ProcessRootObjects(reseter);
+
+    auto drain = [&stack, &shade]() {
+        while (!stack.empty()) {
+            HeapObject *obj = stack.back();
+            stack.pop_back();
+            object::VisitPointers(obj, shade);
+        }
+    };
+
+    ProcessRootObjects(shade);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) shade(*slot);
+    }
+    drain();
+    // The marker skips young objects, old ones reachable only through the
+    // young objects of marked ones are found from dirty cards, kept dirty.
+    ProcessDirtyCards([this, &shade](HeapObject *obj) {
+        DirtyCard(obj);
+        if (IsMarked(obj, marking_epoch_)) object::VisitPointers(obj, shade);
+    });
+    drain();
+    // Every old object alive is marked by now. Cards of the ones referencing
+    // young objects are dirtied again, and the dead ones lose references
+    // which would dangle from a card dirtied later, until swept.
+    ProcessDirtyCards([this](HeapObject *obj) {
+        if (!IsMarked(obj, marking_epoch_)) {
+            HeapObject::CreateFiller(obj, obj->size());
+            return;
+        }
+
+        bool young = false;
+        object::VisitPointers(obj, [this, &young](HeapObject *child) {
+            young = young || IsYoung(child);
+            return child;
+        });
+        if (young) DirtyCard(obj);
+    });
+
+    marking_ = false;
+    HeapObject::set_concurrent_marking(false);
+
+    ResetHoles();
+    if (ShouldCompact()) {
+        Compact();
+    } else {
+        if (SelectEvacuationCandidates()) EvacuateCandidates();
+        ResetBlocks();
+    }
+    compaction_requested_ = false;
+    marking_trigger_ = available_ / 2;
+
+    for (HeapObject *obj : young_live_) obj->set_forwarded(false);
+    young_live_.clear();
+    ScheduleSlice();
 }
 
-void GenerationGC::Compact(ForwardingMap &map) {
-    uint8_t *scan = old_start_;
-    while (scan < end_) {
-        HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
-        while (!obj->forwarded()) {
-            scan += obj->size();
-            obj = reinterpret_cast<HeapObject *>(scan);
+/**
+ * Blocks with few lines alive are evacuated, sparsest first, as long as their
+ * live lines fit in half of the available space.
+ */
+bool GenerationGC::SelectEvacuationCandidates() {
+    std::vector<std::pair<size_t, size_t>> sparse;
+    const size_t used = BlockOf(old_free_);
+    for (size_t block = 0; block < used; ++block) {
+        size_t live = 0;
+        const size_t end = (block + 1) * LINES_PER_BLOCK;
+        for (size_t line = block * LINES_PER_BLOCK; line < end; ++line) {
+            if (line_marks_[line] == marking_epoch_) ++live;
+        }
+        if (live > 0 && live <= EVACUATION_THRESHOLD)
+            sparse.emplace_back(live, block);
+    }
+    std::sort(sparse.begin(), sparse.end());
+
+    size_t budget = available_ / 2;
+    bool selected = false;
+    for (auto &entry : sparse) {
+        size_t size = entry.first * LINE_SIZE;
+        if (size > budget) break;
+        budget -= size;
+
+        // Its free lines aren't available to the evacuation.
+        if (block_states_[entry.second] == RECYCLABLE_BLOCK)
+            available_ -= FreeLines(entry.second) * LINE_SIZE;
+        block_states_[entry.second] = EVACUATING_BLOCK;
+        selected = true;
+    }
+    return selected;
+}
+
+/**
+ * Pass each object marked in the epoch and starting in the blocks to
+ * `visit`, in address order, by scanning the mark bitmap: dead objects are
+ * skipped without being read.
+ */
+template <typename Visit>
+void GenerationGC::VisitMarkedObjects(
+    size_t first_block, size_t last_block, uint8_t epoch, Visit &&visit) {
+    const std::vector<uint64_t> &bits = mark_bits_[epoch & 1];
+    const size_t end = last_block * MARK_WORDS_PER_BLOCK;
+    for (size_t index = first_block * MARK_WORDS_PER_BLOCK; index < end;
+         ++index) {
+        for (uint64_t word = bits[index]; word != 0; word &= word - 1) {
+            size_t bit = index * 64 + __builtin_ctzll(word);
+            visit(reinterpret_cast<HeapObject *>(old_start_ + (bit << 3)));
+        }
+    }
+}
+
+/**
+ * Copy marked objects out of the candidates, leaving their forwarding
+ * pointers behind, then update references held by roots and marked objects.
+ * An object that spans beyond its block, or doesn't fit the space left, stays
+ * and marks its lines again.
+ */
+void GenerationGC::EvacuateCandidates() {
+    for (size_t block = 0; block < num_of_blocks_; ++block) {
+        if (block_states_[block] != EVACUATING_BLOCK) continue;
+
+        uint8_t *const start = BlockStart(block);
+        uint8_t *const end = BlockStart(block + 1);
+        HeapObject *head = ObjectCovering(start);
+        std::fill(
+            line_marks_.begin() + LineOf(start),
+            line_marks_.begin() + LineOf(end), 0);
+        if (reinterpret_cast<uint8_t *>(head) < start &&
+            IsMarked(head, marking_epoch_)) {
+            MarkLines(head);
         }
 
-        assert(map.count(obj));
+        VisitMarkedObjects(
+            block, block + 1, marking_epoch_, [this, end](HeapObject *obj) {
+                size_t size = obj->size();
+                uint8_t *address = nullptr;
+                if (reinterpret_cast<uint8_t *>(obj) + size <= end)
+                    address = AllocateInOldSpace(size);
+                if (address == nullptr) {
+                    MarkLines(obj);
+                    return;
+                }
+
+                memcpy(address, obj, size);
+                HeapObject *copy = reinterpret_cast<HeapObject *>(address);
+                MarkObject(copy);
+                obj->set_forwarded(true);
+                obj->set_forwarding(reinterpret_cast<uintptr_t>(copy));
+
+                bool young = false;
+                object::VisitPointers(copy, [this, &young](HeapObject *child) {
+                    young = young || IsYoung(child);
+                    return child;
+                });
+                if (young) DirtyCard(copy);
+            });
+    }
+
+    auto forward = [this](HeapObject *obj) { return ForwardEvacuated(obj); };
+    ProcessRootObjects(forward);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) *slot = forward(*slot);
+    }
+    for (HeapObject *obj : young_live_) object::VisitPointers(obj, forward);
+
+    VisitMarkedObjects(
+        0, BlockOf(old_free_), marking_epoch_, [&forward](HeapObject *obj) {
+            if (!obj->forwarded()) object::VisitPointers(obj, forward);
+        });
+}
 
-        HeapObject *target = map[obj];
-        memmove(target, obj, obj->size());
+/**
+ * Parse from the object noted for the card of `address` up to the one which
+ * spans over it.
+ */
+GenerationGC::HeapObject *GenerationGC::ObjectCovering(uint8_t *address) {
+    uint8_t *scan = reinterpret_cast<uint8_t *>(card_objects_[CardOf(address)]);
+    for (;;) {
+        HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
         scan += obj->size();
+        if (address < scan) return obj;
+    }
+}
+
+/**
+ * Note the state of blocks from line marks, for allocation, and leave them
+ * to be swept lazily by the marks of this major GC, except the evacuated
+ * ones, whose husks must not outlive the pause. Bits of the one before are
+ * cleared for the blocks it never swept, so that both bitmaps are clear but
+ * this one when the next marking starts.
+ */
+void GenerationGC::ResetBlocks() {
+    std::vector<uint64_t> &bits = mark_bits_[live_epoch_ & 1];
+    const size_t used = BlockOf(old_free_);
+    for (size_t block = 0; block < used; ++block) {
+        if (!swept_[block]) {
+            std::fill(
+                bits.begin() + block * MARK_WORDS_PER_BLOCK,
+                bits.begin() + (block + 1) * MARK_WORDS_PER_BLOCK, 0);
+        }
+        swept_[block] = false;
+    }
+    live_epoch_ = marking_epoch_;
+
+    for (size_t block = 0; block < num_of_blocks_; ++block) {
+        if (block_states_[block] == EVACUATING_BLOCK) SweepBlock(block);
+    }
+    NoteBlockStates();
+}
+
+void GenerationGC::NoteBlockStates() {
+    available_ = 0;
+    for (size_t block = 0; block < num_of_blocks_; ++block) {
+        size_t free = FreeLines(block);
+        available_ += free * LINE_SIZE;
+        if (free == LINES_PER_BLOCK)
+            block_states_[block] = FREE_BLOCK;
+        else if (free > 0)
+            block_states_[block] = RECYCLABLE_BLOCK;
+        else
+            block_states_[block] = UNAVAILABLE_BLOCK;
+    }
+    next_block_ = 0;
+    sweep_cursor_ = 0;
+    ResetHoles();
+}
+
+/**
+ * Format the gaps between objects marked by the last major GC in the block
+ * as fillers, found from the mark bitmap, then clear its bits. Objects
+ * spanning over the edges of the block are the only dead ones read: a large
+ * object from the blocks before, which are never swept while it lives, and
+ * one into the blocks after, whose rest is formatted block by block.
+ */
+void GenerationGC::SweepBlock(size_t block) {
+    uint8_t *const start = BlockStart(block);
+    uint8_t *const end = BlockStart(block + 1);
+    HeapObject *head = ObjectCovering(start);
+    HeapObject *tail = ObjectCovering(end - 1);
+    uint8_t *const tail_end = reinterpret_cast<uint8_t *>(tail) + tail->size();
+
+    uint8_t *dead = start;
+    uint8_t *head_start = reinterpret_cast<uint8_t *>(head);
+    if (head_start < start) {
+        assert(!swept_[BlockOf(head)] && "its marks are cleared");
+        if (IsMarked(head, live_epoch_)) {
+            dead = head_start + head->size();
+        } else {
+            HeapObject::CreateFiller(head, start - head_start);
+        }
+    }
+
+    VisitMarkedObjects(
+        block, block + 1, live_epoch_, [this, &dead](HeapObject *obj) {
+            // Evacuated.
+            if (obj->forwarded()) return;
+
+            uint8_t *live = reinterpret_cast<uint8_t *>(obj);
+            if (dead < live) FormatFree(dead, live);
+            dead = live + obj->size();
+        });
+    if (dead < end) FormatFree(dead, end);
+    if (dead <= end) {
+        for (uint8_t *piece = end; piece < tail_end;) {
+            uint8_t *next = std::min(BlockStart(BlockOf(piece) + 1), tail_end);
+            HeapObject *filler = HeapObject::CreateFiller(piece, next - piece);
+            NoteCardObjects(filler, next);
+            piece = next;
+        }
+    }
+
+    std::vector<uint64_t> &bits = mark_bits_[live_epoch_ & 1];
+    std::fill(
+        bits.begin() + block * MARK_WORDS_PER_BLOCK,
+        bits.begin() + (block + 1) * MARK_WORDS_PER_BLOCK, 0);
+    swept_[block] = true;
+}
+
+/**
+ * Format the dead range [start, end) as fillers, split at blocks and where
+ * lines turn free or not, so that each run of free lines is a filler of its
+ * own, overwritten from its start by the allocator taking it.
+ */
+void GenerationGC::FormatFree(uint8_t *start, uint8_t *end) {
+    while (start < end) {
+        const bool free = IsFreeLine(LineOf(start));
+        uint8_t *next = LineStart(LineOf(start) + 1);
+        while (next < end && LineOf(next) % LINES_PER_BLOCK != 0 &&
+               IsFreeLine(LineOf(next)) == free) {
+            next += LINE_SIZE;
+        }
+        next = std::min(next, end);
+
+        HeapObject *filler = HeapObject::CreateFiller(start, next - start);
+        NoteCardObjects(filler, next);
+        start = next;
+    }
+}
+
+/**
+ * Compaction is left for when evacuation can't help: on request, or when the
+ * lines left free by marking can't hold the survivors of a minor GC, which
+ * would run a major GC before each one. It reclaims what evacuation doesn't,
+ * dead space among live objects in lines and the blocks too dense to empty.
+ */
+bool GenerationGC::ShouldCompact() const {
+    if (compaction_requested_) return true;
+
+    size_t free = 0;
+    for (uint8_t mark : line_marks_) {
+        if (mark != marking_epoch_) ++free;
+    }
+    return free * LINE_SIZE < young_size();
+}
+
+/**
+ * Sliding compaction of old space, in parallel by chunks of blocks, each one
+ * compacted into itself by a worker, so that chunks are independent:
+ *
+ * - Plan: objects marked in a chunk are laid out in address order from its
+ *   start, and the forwarding address of each line with marked objects is
+ *   noted, that of its first one. Objects starting in a line move together,
+ *   the address of any other is found by adding the sizes of the ones marked
+ *   before it in the line, from the bitmap.
+ * - Update: references held by roots and marked objects are forwarded.
+ * - Move: objects slide down to their addresses, and the gaps left are
+ *   formatted as fillers, with line marks, cards and card objects noted
+ *   again.
+ *
+ * Objects never span blocks after it, those which don't fit the rest of a
+ * block go to the next one. Large objects spanning blocks stay.
+ */
+void GenerationGC::Compact() {
+    const size_t used = BlockOf(old_free_);
+    const size_t chunks = (used + BLOCKS_PER_CHUNK - 1) / BLOCKS_PER_CHUNK;
+    line_forwarding_.assign(used * LINES_PER_BLOCK, 0);
+    chunk_heads_.assign(chunks, nullptr);
+
+    ForEachChunk(chunks, [this](size_t chunk) { PlanChunk(chunk); });
+
+    auto forward = [this](HeapObject *obj) { return CompactedAddress(obj); };
+    ProcessRootObjects(forward);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) *slot = forward(*slot);
+    }
+    for (HeapObject *obj : young_live_) object::VisitPointers(obj, forward);
+    ForEachChunk(chunks, [this](size_t chunk) { UpdateChunk(chunk); });
+
+    ForEachChunk(chunks, [this](size_t chunk) { MoveChunk(chunk); });
+
+    std::vector<uint32_t>().swap(line_forwarding_);
+    live_epoch_ = marking_epoch_;
+    NoteBlockStates();
+}
+
+/**
+ * Run `task` on each chunk, on the workers, which claim chunks in turn.
+ */
+template <typename Task>
+void GenerationGC::ForEachChunk(size_t count, Task &&task) {
+    std::atomic<size_t> next(0);
+    auto work = [&next, &task, count]() {
+        for (size_t chunk; (chunk = next.fetch_add(1)) < count;) task(chunk);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t id = 1; id < workers_.size(); ++id) threads.emplace_back(work);
+    work();
+    for (std::thread &thread : threads) thread.join();
+}
+
+/**
+ * Lay out the objects marked in the chunk, noting their forwarding addresses.
+ * An object never moves up: the ones before it take no more space than they
+ * did, but for the rest of the blocks they leave, where it wouldn't fit.
+ */
+void GenerationGC::PlanChunk(size_t chunk) {
+    const size_t first = chunk * BLOCKS_PER_CHUNK;
+    const size_t last = std::min(first + BLOCKS_PER_CHUNK, BlockOf(old_free_));
+    uint8_t *cursor = BlockStart(first);
+    HeapObject *head = ObjectCovering(cursor);
+    if (reinterpret_cast<uint8_t *>(head) < cursor &&
+        IsMarked(head, marking_epoch_)) {
+        chunk_heads_[chunk] = head;
+        cursor = reinterpret_cast<uint8_t *>(head) + head->size();
+    }
+
+    size_t group = SIZE_MAX;
+    VisitMarkedObjects(
+        first, last, marking_epoch_, [this, &cursor, &group](HeapObject *obj) {
+            const size_t line = LineOf(obj);
+            if (line == group) return;
+            group = line;
+
+            uint8_t *address = reinterpret_cast<uint8_t *>(obj);
+            uint8_t *block_end = BlockStart(BlockOf(address) + 1);
+            size_t size;
+            if (address + obj->size() > block_end) {
+                // Large objects start blocks, alone in their first lines.
+                size = obj->size();
+                cursor = address;
+            } else {
+                size = LiveBytesInLine(line, LineStart(line + 1));
+                block_end = BlockStart(BlockOf(cursor) + 1);
+                if (cursor + size > block_end) cursor = block_end;
+            }
+            line_forwarding_[line] =
+                static_cast<uint32_t>((cursor - old_start_) >> 3);
+            cursor += size;
+        });
+}
+
+/**
+ * Forward references of the objects marked in the chunk, and clear its line
+ * marks, noted again as objects move. Its cards are dirtied for the objects
+ * referencing young ones at the addresses they move to: once moved, an
+ * object may reference others which aren't yet, such as the descriptor of a
+ * record, so it is never visited there.
+ */
+void GenerationGC::UpdateChunk(size_t chunk) {
+    const size_t first = chunk * BLOCKS_PER_CHUNK;
+    const size_t last = std::min(first + BLOCKS_PER_CHUNK, BlockOf(old_free_));
+    std::fill(
+        cards_.begin() + CardOf(BlockStart(first)),
+        cards_.begin() + CardOf(BlockStart(last)), CLEAN_CARD);
+
+    VisitMarkedObjects(first, last, marking_epoch_, [this](HeapObject *obj) {
+        bool young = false;
+        object::VisitPointers(obj, [this, &young](HeapObject *child) {
+            young = young || IsYoung(child);
+            return CompactedAddress(child);
+        });
+        if (young) DirtyCard(CompactedAddress(obj));
+    });
+
+    std::fill(
+        line_marks_.begin() + first * LINES_PER_BLOCK,
+        line_marks_.begin() + last * LINES_PER_BLOCK, 0);
+}
+
+/**
+ * Slide the objects marked in the chunk in address order, which never
+ * overwrites one not moved yet. Headers of moved objects are overwritten, so
+ * forwarding addresses within a line follow from the one before. The chunk
+ * is swept once done, its bits of both bitmaps cleared.
+ */
+void GenerationGC::MoveChunk(size_t chunk) {
+    const size_t first = chunk * BLOCKS_PER_CHUNK;
+    const size_t last = std::min(first + BLOCKS_PER_CHUNK, BlockOf(old_free_));
+    uint8_t *cursor = BlockStart(first);
+    if (HeapObject *head = chunk_heads_[chunk]) {
+        // Its lines are marked by the chunk before as well.
+        MarkLines(head);
+        cursor = reinterpret_cast<uint8_t *>(head) + head->size();
+    }
+
+    size_t group = SIZE_MAX;
+    VisitMarkedObjects(
+        first, last, marking_epoch_, [this, &cursor, &group](HeapObject *obj) {
+            const size_t size = obj->size();
+            const size_t line = LineOf(obj);
+            if (line != group) {
+                group = line;
+                uint8_t *address = old_start_ +
+                    (static_cast<size_t>(line_forwarding_[line]) << 3);
+                if (cursor < address) FormatFree(cursor, address);
+                cursor = address;
+            }
+
+            HeapObject *moved = reinterpret_cast<HeapObject *>(cursor);
+            if (moved != obj) memmove(moved, obj, size);
+            cursor += size;
+            MarkLines(moved);
+            NoteCardObjects(moved, cursor);
+        });
+    if (cursor < BlockStart(last)) FormatFree(cursor, BlockStart(last));
+
+    for (auto &bits : mark_bits_) {
+        std::fill(
+            bits.begin() + first * MARK_WORDS_PER_BLOCK,
+            bits.begin() + last * MARK_WORDS_PER_BLOCK, 0);
+    }
+    std::fill(swept_.begin() + first, swept_.begin() + last, true);
+}
+
+/**
+ * Bytes of the objects marked in the line, before `limit`.
+ */
+size_t GenerationGC::LiveBytesInLine(size_t line, const uint8_t *limit) const {
+    const std::vector<uint64_t> &bits = mark_bits_[marking_epoch_ & 1];
+    const size_t first = MarkBitOf(LineStart(line));
+    const size_t count = MarkBitOf(limit) - first;
+    // A line is a slice of a bitmap word.
+    uint64_t word = bits[first >> 6] >> (first & 63);
+    word &= (static_cast<uint64_t>(1) << count) - 1;
+
+    size_t size = 0;
+    for (; word != 0; word &= word - 1) {
+        size_t bit = first + __builtin_ctzll(word);
+        size += reinterpret_cast<HeapObject *>(old_start_ + (bit << 3))->size();
     }
+    return size;
 }
 
 void GenerationGC::FullGC() {
+    compaction_requested_ = true;
     MajorGC();
     MinorGC();
 }
@@ -0,0 +1,713 @@
+#include <nerangake/gc/region_gc.h>
+
+#include <assert.h>
+#include <string.h> // memcpy
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept> // exception
+
+#include <nerangake/context.h>
+#include <nerangake/object/visitor.h>
+
+namespace nrk {
+namespace gc {
+
+// Objects are 8 bytes aligned, as in `GenerationGC`.
+static size_t Align(size_t value) { return (value + 0x7) & ~0x7; }
+
+// Predictions follow new samples at this weight.
+static const double DECAY = 0.3;
+
+static double Decay(double average, double sample) {
+    return average * (1.0 - DECAY) + sample * DECAY;
+}
+
+static double Since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+RegionGC::RegionGC(size_t size, double pause_target_ms)
+    : space_size_(size & ~(REGION_SIZE - 1))
+    , start_(new uint8_t[space_size_])
+    , end_(start_ + space_size_)
+    , num_of_regions_(space_size_ >> REGION_SHIFT)
+    , pause_target_(pause_target_ms * 1e6) {
+    if (num_of_regions_ < 4) {
+        delete[] start_;
+        throw std::runtime_error("heap too small for regions.");
+    }
+
+    regions_.resize(num_of_regions_);
+    for (size_t region = num_of_regions_; region-- > 0;) {
+        regions_[region].top = RegionStart(region);
+        free_regions_.push_back(region);
+    }
+    eden_region_ = survivor_region_ = old_region_ = NO_REGION;
+    eden_count_ = survivor_count_ = 0;
+    young_target_ = std::max<size_t>(1, num_of_regions_ / 10);
+
+    cards_.assign(space_size_ >> CARD_SHIFT, CLEAN_CARD);
+    card_objects_.assign(space_size_ >> CARD_SHIFT, nullptr);
+    mark_bits_.assign(space_size_ / 8 / 64, 0);
+    mixed_min_ = 0;
+    marked_occupancy_ = 0;
+
+    copy_cost_ = 2.0;
+    card_cost_ = 200.0;
+    survival_rate_ = 0.5;
+}
+
+RegionGC::~RegionGC() { delete[] start_; }
+
+void RegionGC::AllocationFail() {
+    throw std::runtime_error("run out of memory.");
+}
+
+void RegionGC::ProcessRootObjects(
+    const memory::RootObjectHolderInterface::Callback &cb) {
+    for (auto it = Context::root_object_holder_begin(),
+              end = Context::root_object_holder_end();
+         it != end; ++it) {
+        (*it)->ProcessRootObject(cb);
+    }
+}
+
+/**
+ * Objects are allocated in eden regions, static ones in old regions, and
+ * humongous ones in runs of free regions of their own.
+ */
+void *RegionGC::Allocate(memory::AllocateType type, size_t size) {
+    size = Align(size);
+
+    uint8_t *result;
+    if (size >= HUMONGOUS_SIZE)
+        result = AllocateHumongous(size);
+    else if (type == memory::AllocateType::Static)
+        result = AllocateStatic(size);
+    else
+        result = AllocateYoung(size);
+
+    HeapObject *object = reinterpret_cast<HeapObject *>(result);
+    object->set_age(0u);
+    object->set_forwarded(false);
+    object->set_size(static_cast<uint32_t>(size));
+    if (!IsYoung(object)) NoteCardObjects(object, result + size);
+    return result;
+}
+
+uint8_t *RegionGC::AllocateYoung(size_t size) {
+    uint8_t *result = BumpRegion(&eden_region_, EDEN_REGION, size);
+    if (result == nullptr) {
+        MinorGC();
+        result = BumpRegion(&eden_region_, EDEN_REGION, size);
+    }
+    if (result == nullptr) {
+        FullGC();
+        result = BumpRegion(&eden_region_, EDEN_REGION, size);
+        if (result == nullptr) AllocationFail();
+    }
+    return result;
+}
+
+uint8_t *RegionGC::AllocateStatic(size_t size) {
+    uint8_t *result = BumpRegion(&old_region_, OLD_REGION, size);
+    if (result == nullptr) {
+        MinorGC();
+        result = BumpRegion(&old_region_, OLD_REGION, size);
+    }
+    if (result == nullptr) {
+        FullGC();
+        result = BumpRegion(&old_region_, OLD_REGION, size);
+        if (result == nullptr) AllocationFail();
+    }
+    return result;
+}
+
+/**
+ * A run of free regions is needed, which a young collection may not leave:
+ * a full one evacuates every old region worth it, as for the other
+ * allocations.
+ */
+uint8_t *RegionGC::AllocateHumongous(size_t size) {
+    uint8_t *result = TakeHumongousRegions(size);
+    if (result == nullptr) {
+        MinorGC();
+        result = TakeHumongousRegions(size);
+    }
+    if (result == nullptr) {
+        FullGC();
+        result = TakeHumongousRegions(size);
+        if (result == nullptr) AllocationFail();
+    }
+    return result;
+}
+
+uint8_t *RegionGC::TakeHumongousRegions(size_t size) {
+    const size_t count = (size + REGION_SIZE - 1) >> REGION_SHIFT;
+    size_t first = 0, run = 0;
+    for (size_t region = 0; region < num_of_regions_ && run < count;
+         ++region) {
+        if (regions_[region].type != FREE_REGION) {
+            run = 0;
+        } else if (run++ == 0) {
+            first = region;
+        }
+    }
+    if (run < count) return nullptr;
+
+    uint8_t *result = RegionStart(first);
+    for (size_t region = first; region < first + count; ++region) {
+        free_regions_.erase(
+            std::find(free_regions_.begin(), free_regions_.end(), region));
+        Region &taken = regions_[region];
+        taken.type = region == first ? HUMONGOUS_REGION : HUMONGOUS_CONT_REGION;
+        taken.top = std::min(RegionStart(region + 1), result + size);
+    }
+    return result;
+}
+
+/**
+ * Bump the region allocated into, or take a free one once it is full. Eden
+ * takes no more than `young_target_` regions between collections, nor more
+ * than the free regions left may hold once evacuated.
+ */
+uint8_t *RegionGC::BumpRegion(size_t *alloc, RegionType type, size_t size) {
+    assert(size <= REGION_SIZE && "larger than a region");
+    if (*alloc == NO_REGION ||
+        size > static_cast<size_t>(
+                   RegionStart(*alloc + 1) - regions_[*alloc].top)) {
+        if (type == EDEN_REGION &&
+            (eden_count_ >= young_target_ || !CanGrowEden())) {
+            return nullptr;
+        }
+        size_t region = TakeFreeRegion(type);
+        if (region == NO_REGION) return nullptr;
+        if (type == EDEN_REGION)
+            ++eden_count_;
+        else if (type == SURVIVOR_REGION)
+            ++survivor_count_;
+        *alloc = region;
+    }
+
+    Region &region = regions_[*alloc];
+    uint8_t *result = region.top;
+    region.top += size;
+    return result;
+}
+
+size_t RegionGC::TakeFreeRegion(RegionType type) {
+    if (free_regions_.empty()) return NO_REGION;
+
+    size_t region = free_regions_.back();
+    free_regions_.pop_back();
+    regions_[region].type = type;
+    return region;
+}
+
+/**
+ * Humongous objects take free regions after eden is sized, which survivors
+ * need: evacuating into too few fails, and turns young regions old with
+ * their garbage.
+ */
+bool RegionGC::CanGrowEden() const {
+    const size_t young = eden_count_ + survivor_count_ + 1;
+    const size_t surviving = static_cast<size_t>(young * survival_rate_) + 1;
+    return free_regions_.size() > surviving;
+}
+
+void RegionGC::FreeRegion(size_t region) {
+    Region &freed = regions_[region];
+    freed.type = FREE_REGION;
+    freed.top = RegionStart(region);
+    freed.in_collection_set = false;
+    freed.evacuation_failed = false;
+    freed.live_bytes = 0;
+    freed.remembered_set.clear();
+    free_regions_.push_back(region);
+}
+
+void RegionGC::NoteCardObjects(HeapObject *obj, uint8_t *end) {
+    uint8_t *start = reinterpret_cast<uint8_t *>(obj);
+    size_t card = CardOf(start + CARD_SIZE - 1);
+    for (; CardStart(card) < end; ++card) card_objects_[card] = obj;
+}
+
+/**
+ * References across regions are remembered by the card of the object header,
+ * except those from young objects, which are always evacuated and scanned.
+ */
+void RegionGC::WriteBarrier(
+    HeapObject *obj, RawObject **field, HeapObject *new_obj) {
+    *field = new_obj;
+    if (IsYoung(obj) || RegionOf(obj) == RegionOf(new_obj)) return;
+    DirtyCard(obj);
+}
+
+void RegionGC::WriteBarrierRange(
+    HeapObject *obj, RawObject **fields, size_t count) {
+    if (IsYoung(obj)) return;
+
+    for (size_t i = 0; i < count; ++i) {
+        RawObject *field = fields[i];
+        if (field->IsObject() &&
+            RegionOf(obj) != RegionOf(HeapObject::From(field))) {
+            DirtyCard(obj);
+            return;
+        }
+    }
+}
+
+/**
+ * Add the cards dirtied since the last collection to the remembered sets of
+ * the regions their objects reference.
+ */
+void RegionGC::RefineDirtyCards() {
+    for (uint32_t card : dirty_cards_) {
+        cards_[card] = CLEAN_CARD;
+        VisitCardObjects(card, [this](HeapObject *obj) {
+            object::VisitPointers(obj, [this, obj](HeapObject *child) {
+                Remember(obj, child);
+                return child;
+            });
+        });
+    }
+    dirty_cards_.clear();
+}
+
+/**
+ * Pass each object starting in the card to `visit`, if it is in an old or
+ * humongous region out of the collection set. Remembered sets keep the cards
+ * of regions freed since, which are skipped, or taken again, whose objects
+ * are scanned for nothing.
+ */
+template <typename Visit>
+void RegionGC::VisitCardObjects(uint32_t card, Visit &&visit) {
+    const Region &region = regions_[RegionOf(CardStart(card))];
+    if (region.in_collection_set ||
+        (region.type != OLD_REGION && region.type != HUMONGOUS_REGION)) {
+        return;
+    }
+
+    uint8_t *const start = CardStart(card);
+    uint8_t *const end = std::min(CardStart(card + 1), region.top);
+    if (start >= end) return;
+
+    uint8_t *scan = reinterpret_cast<uint8_t *>(card_objects_[card]);
+    while (scan < end) {
+        HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
+        scan += obj->size();
+        if (reinterpret_cast<uint8_t *>(obj) < start || obj->IsFiller())
+            continue;
+        visit(obj);
+    }
+}
+
+/**
+ * Objects of old and humongous regions are remembered, and those staying in
+ * the regions of the collection set which failed to evacuate.
+ */
+bool RegionGC::RemembersFrom(size_t region) const {
+    const Region &from = regions_[region];
+    if (from.evacuation_failed) return true;
+    return !from.in_collection_set &&
+        (from.type == OLD_REGION || from.type == HUMONGOUS_REGION);
+}
+
+void RegionGC::Remember(HeapObject *holder, HeapObject *target) {
+    const size_t from = RegionOf(holder), to = RegionOf(target);
+    if (from == to || !RemembersFrom(from)) return;
+
+    // Humongous objects are never evacuated.
+    Region &region = regions_[to];
+    if (region.type == HUMONGOUS_REGION) return;
+    region.remembered_set.insert(static_cast<uint32_t>(CardOf(holder)));
+}
+
+/**
+ * A young collection, mixed with old regions while candidates of the last
+ * marking are left. Marking starts once old regions take much of the heap,
+ * and have grown by a young generation since the last one.
+ */
+void RegionGC::MinorGC() {
+    Collect(false);
+
+    const size_t old_regions = OldRegions();
+    if (candidates_.empty() &&
+        old_regions * 100 >= num_of_regions_ * INITIATING_OCCUPANCY &&
+        old_regions >= marked_occupancy_ + young_target_) {
+        MajorGC();
+    }
+}
+
+/**
+ * Mark the heap in a pause and note the live bytes of each region, then free
+ * the regions found dead and choose candidates of mixed collections.
+ */
+void RegionGC::MajorGC() {
+    Mark();
+    Cleanup();
+}
+
+/**
+ * Candidates are evacuated as far as the free regions hold them, each
+ * collection freeing regions for the next.
+ */
+void RegionGC::FullGC() {
+    Mark();
+    Cleanup();
+    size_t left;
+    do {
+        left = candidates_.size();
+        Collect(true);
+    } while (!candidates_.empty() && candidates_.size() < left);
+}
+
+/**
+ * An evacuation pause: the collection set is evacuated from roots and its
+ * remembered sets, then copies are scanned until every object it holds
+ * alive is out. Young objects are copied into survivor regions until old
+ * enough, the others into old regions. An object which doesn't fit the free
+ * regions left stays, forwarded to itself, and its region turns old.
+ */
+void RegionGC::Collect(bool all_candidates) {
+    const auto start = std::chrono::steady_clock::now();
+    RefineDirtyCards();
+
+    eden_region_ = survivor_region_ = NO_REGION;
+    const size_t young_bytes = ChooseCollectionSet(all_candidates);
+    survivor_count_ = 0;
+    copied_bytes_ = young_copied_bytes_ = 0;
+
+    auto evacuate = [this](HeapObject *obj) { return Evacuate(obj); };
+    ProcessRootObjects(evacuate);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) *slot = evacuate(*slot);
+    }
+
+    // Cards are gathered first, scanning them may remember more in the
+    // regions which fail to evacuate.
+    const auto remembered = std::chrono::steady_clock::now();
+    for (Region &region : regions_) {
+        if (!region.in_collection_set) continue;
+        for (uint32_t card : region.remembered_set) {
+            if (cards_[card] == SCANNED_CARD) continue;
+            cards_[card] = SCANNED_CARD;
+            scanned_cards_.push_back(card);
+        }
+    }
+    for (uint32_t card : scanned_cards_) {
+        VisitCardObjects(card, [this](HeapObject *obj) { ScanObject(obj); });
+    }
+    scanned_card_count_ = scanned_cards_.size();
+    const double remembered_set_time = Since(remembered);
+
+    while (!scan_stack_.empty()) {
+        HeapObject *obj = scan_stack_.back();
+        scan_stack_.pop_back();
+        ScanObject(obj);
+    }
+
+    for (uint32_t card : scanned_cards_) cards_[card] = CLEAN_CARD;
+    scanned_cards_.clear();
+    for (size_t region = 0; region < num_of_regions_; ++region) {
+        if (!regions_[region].in_collection_set) continue;
+        if (regions_[region].evacuation_failed)
+            RestoreFailedRegion(region);
+        else
+            FreeRegion(region);
+    }
+    eden_count_ = 0;
+
+    UpdatePredictions(Since(start), remembered_set_time, young_bytes);
+}
+
+/**
+ * All young regions, then candidates, the most efficient first, while the
+ * pause predicted fits the target. A mixed collection takes `mixed_min_`
+ * candidates at least, so that they are all taken in a few. No collection
+ * takes more than the free regions are predicted to hold.
+ *
+ * @return  bytes allocated in the young regions.
+ */
+size_t RegionGC::ChooseCollectionSet(bool all_candidates) {
+    size_t young_bytes = 0;
+    for (size_t region = 0; region < num_of_regions_; ++region) {
+        Region &chosen = regions_[region];
+        if (chosen.type != EDEN_REGION && chosen.type != SURVIVOR_REGION)
+            continue;
+        chosen.in_collection_set = true;
+        young_bytes += chosen.top - RegionStart(region);
+    }
+
+    // Copies leave the end of regions unused, a region is kept for it.
+    const double room = free_regions_.empty()
+        ? 0.0
+        : static_cast<double>((free_regions_.size() - 1) * REGION_SIZE);
+    double copied = young_bytes * survival_rate_;
+    double predicted = copied * copy_cost_;
+    for (size_t taken = 0; !candidates_.empty(); ++taken) {
+        size_t region = candidates_.back();
+        double cost = PredictOldRegion(region);
+        if (!all_candidates && taken >= mixed_min_ &&
+            predicted + cost > pause_target_) {
+            break;
+        }
+        if (copied + regions_[region].live_bytes > room) break;
+        candidates_.pop_back();
+        regions_[region].in_collection_set = true;
+        copied += regions_[region].live_bytes;
+        predicted += cost;
+    }
+    return young_bytes;
+}
+
+/**
+ * Copy the object if it is in the collection set and not yet copied, its
+ * references are evacuated once it is scanned, see `ScanObject`.
+ */
+RegionGC::HeapObject *RegionGC::Evacuate(HeapObject *obj) {
+    Region &region = regions_[RegionOf(obj)];
+    if (!region.in_collection_set) return obj;
+    if (obj->forwarded()) {
+        if (obj->age() == SELF_FORWARDED_AGE) return obj;
+        return reinterpret_cast<HeapObject *>(obj->forwarding());
+    }
+
+    // A surviving tiny slice is copied out as a flat `String`, as
+    // `GenerationGC` does.
+    size_t size = obj->size();
+    // A copy out as large as a humongous object would need regions of its
+    // own, the slice is copied as it is.
+    StringSlice *slice = nullptr;
+    if (obj->IsStringSlice() &&
+        HeapObject::Cast<StringSlice>(obj)->ShouldCopyOut() &&
+        HeapObject::Cast<StringSlice>(obj)->CopyOutSize() < HUMONGOUS_SIZE) {
+        slice = HeapObject::Cast<StringSlice>(obj);
+        size = Align(slice->CopyOutSize());
+    }
+
+    const bool young = region.type != OLD_REGION;
+    const uint8_t age = young ? obj->age() + 1 : MAX_AGE;
+    uint8_t *address = nullptr;
+    if (age < MAX_AGE)
+        address = BumpRegion(&survivor_region_, SURVIVOR_REGION, size);
+    if (address == nullptr)
+        address = BumpRegion(&old_region_, OLD_REGION, size);
+    if (address == nullptr) {
+        region.evacuation_failed = true;
+        obj->set_age(SELF_FORWARDED_AGE);
+        obj->set_forwarded(true);
+        scan_stack_.push_back(obj);
+        return obj;
+    }
+
+    HeapObject *copy = reinterpret_cast<HeapObject *>(address);
+    if (slice != nullptr) {
+        copy->set_forwarded(false);
+        copy->set_size(static_cast<uint32_t>(size));
+        slice->CopyOut(copy);
+    } else {
+        memcpy(copy, obj, size);
+    }
+    copy->set_age(age);
+    if (!IsYoung(copy)) NoteCardObjects(copy, address + size);
+
+    obj->set_forwarded(true);
+    obj->set_forwarding(reinterpret_cast<uintptr_t>(copy));
+    copied_bytes_ += size;
+    if (young) young_copied_bytes_ += size;
+    scan_stack_.push_back(copy);
+    return copy;
+}
+
+void RegionGC::ScanObject(HeapObject *obj) {
+    object::VisitPointers(obj, [this, obj](HeapObject *child) {
+        HeapObject *moved = Evacuate(child);
+        Remember(obj, moved);
+        return moved;
+    });
+}
+
+/**
+ * Keep the objects forwarded to themselves, turning the region old, and
+ * format the others as fillers: copied ones, and dead ones whose references
+ * may dangle.
+ */
+void RegionGC::RestoreFailedRegion(size_t region) {
+    Region &failed = regions_[region];
+    uint8_t *dead = nullptr;
+    uint8_t *scan = RegionStart(region);
+    while (scan < failed.top) {
+        HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
+        const size_t size = obj->size();
+        if (obj->forwarded() && obj->age() == SELF_FORWARDED_AGE) {
+            if (dead != nullptr) {
+                HeapObject *filler =
+                    HeapObject::CreateFiller(dead, scan - dead);
+                NoteCardObjects(filler, scan);
+                dead = nullptr;
+            }
+            obj->set_forwarded(false);
+            obj->set_age(MAX_AGE);
+            NoteCardObjects(obj, scan + size);
+        } else if (dead == nullptr) {
+            dead = scan;
+        }
+        scan += size;
+    }
+    if (dead != nullptr) {
+        HeapObject *filler = HeapObject::CreateFiller(dead, scan - dead);
+        NoteCardObjects(filler, scan);
+    }
+
+    failed.type = OLD_REGION;
+    failed.in_collection_set = false;
+    failed.evacuation_failed = false;
+    failed.live_bytes = failed.top - RegionStart(region);
+}
+
+double RegionGC::PredictOldRegion(size_t region) const {
+    const Region &old = regions_[region];
+    return old.live_bytes * copy_cost_ +
+        old.remembered_set.size() * card_cost_;
+}
+
+/**
+ * Average the costs of this pause into the predictions, then size eden so
+ * that the next young collection fits the pause target, within bounds.
+ */
+void RegionGC::UpdatePredictions(
+    double elapsed, double remembered_set_time, size_t young_bytes) {
+    // Too few samples are mostly noise.
+    if (scanned_card_count_ >= 16) {
+        card_cost_ =
+            Decay(card_cost_, remembered_set_time / scanned_card_count_);
+    }
+    if (copied_bytes_ >= 64 * 1024) {
+        copy_cost_ =
+            Decay(copy_cost_, (elapsed - remembered_set_time) / copied_bytes_);
+    }
+    if (young_bytes > 0) {
+        survival_rate_ = Decay(
+            survival_rate_,
+            static_cast<double>(young_copied_bytes_) / young_bytes);
+    }
+
+    double per_region = REGION_SIZE * std::max(survival_rate_, 0.01) *
+        copy_cost_;
+    size_t target = static_cast<size_t>(pause_target_ / per_region);
+    size_t reserve = num_of_regions_ * RESERVE_PERCENT / 100;
+    size_t free = free_regions_.size();
+    target = std::min(target, num_of_regions_ * MAX_EDEN_PERCENT / 100);
+    target = std::min(target, free > reserve ? free - reserve : 0);
+    young_target_ = std::max<size_t>(target, 1);
+}
+
+void RegionGC::Mark() {
+    std::fill(mark_bits_.begin(), mark_bits_.end(), 0);
+    for (Region &region : regions_) region.live_bytes = 0;
+
+    std::vector<HeapObject *> stack;
+    auto mark = [this, &stack](HeapObject *obj) {
+        if (MarkObject(obj)) stack.push_back(obj);
+        return obj;
+    };
+
+    ProcessRootObjects(mark);
+    for (HeapObject **slot : temp_stack_) {
+        if (*slot != nullptr) mark(*slot);
+    }
+    while (!stack.empty()) {
+        HeapObject *obj = stack.back();
+        stack.pop_back();
+        object::VisitPointers(obj, mark);
+    }
+}
+
+/**
+ * Free the old and humongous regions found dead, and format the dead objects
+ * of the others as fillers: their references may dangle once the regions
+ * they reference are freed. Old regions with enough garbage become
+ * candidates, sorted by the bytes they reclaim for their predicted cost.
+ */
+void RegionGC::Cleanup() {
+    // The region promoted into isn't a candidate.
+    old_region_ = NO_REGION;
+    candidates_.clear();
+
+    for (size_t region = 0; region < num_of_regions_; ++region) {
+        Region &cleaned = regions_[region];
+        if (cleaned.type == HUMONGOUS_REGION) {
+            if (IsMarked(reinterpret_cast<HeapObject *>(RegionStart(region))))
+                continue;
+            FreeRegion(region);
+            for (size_t cont = region + 1; cont < num_of_regions_ &&
+                 regions_[cont].type == HUMONGOUS_CONT_REGION;
+                 ++cont) {
+                FreeRegion(cont);
+            }
+        } else if (cleaned.type == OLD_REGION) {
+            if (cleaned.live_bytes == 0) {
+                FreeRegion(region);
+                continue;
+            }
+            ScrubRegion(region);
+            if (cleaned.live_bytes * 100 < REGION_SIZE * MIXED_LIVE_THRESHOLD)
+                candidates_.push_back(region);
+        }
+    }
+
+    auto efficiency = [this](size_t region) {
+        return (REGION_SIZE - regions_[region].live_bytes) /
+            PredictOldRegion(region);
+    };
+    std::sort(
+        candidates_.begin(), candidates_.end(),
+        [&efficiency](size_t a, size_t b) {
+            return efficiency(a) < efficiency(b);
+        });
+    mixed_min_ = (candidates_.size() + MIXED_COLLECTIONS - 1) /
+        MIXED_COLLECTIONS;
+    marked_occupancy_ = OldRegions();
+}
+
+void RegionGC::ScrubRegion(size_t region) {
+    const Region &scrubbed = regions_[region];
+    uint8_t *dead = nullptr;
+    uint8_t *scan = RegionStart(region);
+    while (scan < scrubbed.top) {
+        HeapObject *obj = reinterpret_cast<HeapObject *>(scan);
+        if (IsMarked(obj)) {
+            if (dead != nullptr) {
+                HeapObject *filler =
+                    HeapObject::CreateFiller(dead, scan - dead);
+                NoteCardObjects(filler, scan);
+                dead = nullptr;
+            }
+        } else if (dead == nullptr) {
+            dead = scan;
+        }
+        scan += obj->size();
+    }
+    if (dead != nullptr) {
+        HeapObject *filler = HeapObject::CreateFiller(dead, scan - dead);
+        NoteCardObjects(filler, scan);
+    }
+}
+
+size_t RegionGC::OldRegions() const {
+    size_t count = 0;
+    for (const Region &region : regions_) {
+        if (region.type == OLD_REGION || region.type == HUMONGOUS_REGION ||
+            region.type == HUMONGOUS_CONT_REGION) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+} // namespace gc
+} // namespace nrk
@@ -33,7 +33,8 @@ uint8_t Instruction::C(const uint8_t *code) {
 uint16_t Instruction::Bx(const uint8_t *code) {
     assert(code && "nullptr exception");
 
-    return LittleEndianToLocal(*reinterpret_cast<const uint16_t *>(code));
+    return LittleEndianToLocal(
+        *reinterpret_cast<const uint16_t *>(code + 2));
 }
 
 uint32_t Instruction::Ax(const uint8_t *code) {
@@ -78,6 +79,10 @@ const uint8_t *Instruction::Next(const uint8_t *pc, int32_t offset) {
     return pc + offset * LEN_OF_INSTRUCTION;
 }
 
+uint32_t Instruction::Distance(const uint8_t *base, const uint8_t *pc) {
+    return static_cast<uint32_t>((pc - base) / LEN_OF_INSTRUCTION);
+}
+
 union EndianTest {
     struct {
         int8_t a;
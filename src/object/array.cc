@@ -5,15 +5,8 @@
 namespace nrk {
 namespace object {
 
-static void ProcessChildren(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception.");
-
-    Array *array = HeapObject::Cast<Array>(obj);
-    array->Children(cb);
-}
-
 static const ObjectMethodTable *VTable() {
-    static ObjectMethodTable table = {nullptr, nullptr, &ProcessChildren};
+    static ObjectMethodTable table = {nullptr, nullptr};
     return &table;
 }
 
@@ -55,21 +48,30 @@ const Array::Element Array::Get(size_t idx) const {
 void Array::Set(size_t idx, Element obj) {
     if (idx >= length()) throw std::runtime_error("out of array range");
 
+    SetArrayField<kBuffer>(idx, obj);
+}
+
+void Array::Move(size_t at, const Array *src, size_t begin, size_t count) {
+    if (at + count > length() || begin + count > src->length())
+        throw std::runtime_error("out of array range");
+
     Element *buf = buffer();
-    buf[idx] = obj;
+    PreWriteBarrierRange(buf + at, count);
+    MoveSlots(buf + at, src->buffer() + begin, count);
+    WriteBarrierRange(buf + at, count);
 }
 
-void Array::set_length(uint32_t size) { SetField<kLength, uint32_t>(size); }
+void Array::Fill(size_t begin, size_t end, Element obj) {
+    if (begin > end || end > length())
+        throw std::runtime_error("out of array range");
 
-void Array::Children(const ForwardingCallback &cb) {
     Element *buf = buffer();
-    uint32_t len = length();
-    for (uint32_t i = 0; i < len; ++i) {
-        if (!buf[i]->IsObject()) continue;
-        HeapObject *obj = HeapObject::From(buf[i]);
-        buf[i] = ForwardingObject<HeapObject>(cb, obj);
-    }
+    PreWriteBarrierRange(buf + begin, end - begin);
+    FillSlots(buf + begin, obj, end - begin);
+    if (obj->IsObject()) WriteBarrierRange(buf + begin, end - begin);
 }
 
+void Array::set_length(uint32_t size) { SetField<kLength, uint32_t>(size); }
+
 } // namespace object
 } // namespace nrk
@@ -7,15 +7,8 @@ namespace object {
 
 static const int NUM_OF_REGISTERS = 32;
 
-static void ProcessChildren(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception.");
-
-    CallInfo *ci = HeapObject::Cast<CallInfo>(obj);
-    ci->Children(cb);
-}
-
 static const ObjectMethodTable *VTable() {
-    static ObjectMethodTable table = {nullptr, nullptr, &ProcessChildren};
+    static ObjectMethodTable table = {nullptr, nullptr};
     return &table;
 }
 
@@ -146,17 +139,5 @@ uint8_t CallInfo::num_of_params() const {
     return GetFieldAs<uint8_t, kNumOfParams>();
 }
 
-void CallInfo::Children(const ForwardingCallback &cb) {
-    if (is_light_func()) {
-        const UserClosure *closure = user_callee();
-        closure = ForwardingObject<UserClosure>(cb, closure);
-        set_callee(closure);
-    } else {
-        const Closure *closure = callee();
-        closure = ForwardingObject<Closure>(cb, closure);
-        set_callee(closure);
-    }
-}
-
 } // namespace object
 } // namespace nrk
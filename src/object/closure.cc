@@ -5,15 +5,8 @@
 namespace nrk {
 namespace object {
 
-static void Children(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception");
-
-    Closure *closure = HeapObject::Cast<Closure>(obj);
-    closure->Children(cb);
-}
-
 static const ObjectMethodTable *VTable() {
-    static ObjectMethodTable table = {nullptr, nullptr, &Children};
+    static ObjectMethodTable table = {nullptr, nullptr};
     return &table;
 }
 
@@ -76,20 +69,5 @@ void Closure::set_captured(unsigned idx, Element e) {
     SetArrayField<kCaptureds>(idx, e);
 }
 
-void Closure::Children(const ForwardingCallback &cb) {
-    const Prototype *proto = callee();
-    proto = ForwardingObject<Prototype>(cb, proto);
-    set_callee(proto);
-
-    uint16_t num_of_captureds = this->num_of_captureds();
-    for (uint16_t i = 0; i < num_of_captureds; ++i) {
-        RawObject *raw = captured(i);
-        if (!raw->IsObject()) continue;
-        HeapObject *obj = HeapObject::From(raw);
-        obj = ForwardingObject<HeapObject>(cb, obj);
-        set_captured(i, obj);
-    }
-}
-
 } // namespace object
 } // namespace nrk
@@ -16,7 +16,7 @@ static bool Equals(const HeapObject *lhs, const HeapObject *rhs) {
 }
 
 static const ObjectMethodTable *VTable() {
-    static ObjectMethodTable table = {&Equals, nullptr, nullptr};
+    static ObjectMethodTable table = {&Equals, nullptr};
     return &table;
 }
 
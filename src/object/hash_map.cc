@@ -1,193 +1,815 @@
 #include <nerangake/object/hash_map.h>
 
 #include <assert.h>
+#include <string.h> // memset
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
 #include <stdexcept>
 
 #include <nerangake/context.h>
+#include <nerangake/object/string.h>
 
 namespace nrk {
 namespace object {
 
-static void Children(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception");
+static const uint32_t HASH_MULTIPLIER = 0x9E3779B1;
+
+/**
+ * Scramble hash code, so keys with consecutive hash codes (such as Fixnum)
+ * spread over groups. H1 selects the group, H2 is stored in control byte.
+ */
+static uint32_t Mix(uint32_t hash) { return hash * HASH_MULTIPLIER; }
+
+static uint32_t H1(uint32_t hash) { return Mix(hash) >> 7; }
+
+static uint8_t H2(uint32_t hash) { return Mix(hash) & 0x7F; }
+
+/**
+ * Group - match control bytes of a group, the i-th bit of result is set if
+ * the i-th control byte matches.
+ */
+struct Group {
+#if defined(__SSE2__)
+    static uint32_t Match(const uint8_t *control, uint8_t h2) {
+        __m128i group = Load(control);
+        __m128i target = _mm_set1_epi8(static_cast<char>(h2));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, target));
+    }
+
+    static uint32_t MatchEmpty(const uint8_t *control) {
+        return Match(control, HashTable::kEmpty);
+    }
+
+    // Both kEmpty and kTombstone have the highest bit set.
+    static uint32_t MatchEmptyOrDeleted(const uint8_t *control) {
+        return _mm_movemask_epi8(Load(control));
+    }
+
+private:
+    static __m128i Load(const uint8_t *control) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(control));
+    }
+#else
+    static uint32_t Match(const uint8_t *control, uint8_t h2) {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < HashTable::kGroupWidth; ++i)
+            if (control[i] == h2) mask |= 1u << i;
+        return mask;
+    }
 
-    HashNode *node = HeapObject::Cast<HashNode>(obj);
-    node->Children(cb);
+    static uint32_t MatchEmpty(const uint8_t *control) {
+        return Match(control, HashTable::kEmpty);
+    }
+
+    static uint32_t MatchEmptyOrDeleted(const uint8_t *control) {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < HashTable::kGroupWidth; ++i)
+            if (control[i] & HashTable::kEmpty) mask |= 1u << i;
+        return mask;
+    }
+#endif
+};
+
+static uint32_t LowestBit(uint32_t mask) { return __builtin_ctz(mask); }
+
+/**
+ * SmallGroup - match all control bytes of a small table in one word (SWAR),
+ * the highest bit of the i-th byte of result is set if the i-th control byte
+ * may match. False positives are filtered by comparing keys.
+ */
+struct SmallGroup {
+    static const uint64_t kLsbs = 0x0101010101010101ull;
+    static const uint64_t kMsbs = 0x8080808080808080ull;
+
+    // Control bytes beyond capacity read as kEmpty.
+    static uint64_t Load(const uint8_t *control, uint32_t capacity) {
+        assert(capacity <= sizeof(uint64_t) && "table is not small");
+        uint64_t word = kMsbs;
+        memcpy(&word, control, capacity);
+        return word;
+    }
+
+    static uint64_t Match(uint64_t word, uint8_t h2) {
+        uint64_t x = word ^ (kLsbs * h2);
+        return (x - kLsbs) & ~x & kMsbs;
+    }
+
+    static uint64_t MatchEmpty(uint64_t word) { return word & kMsbs; }
+
+    static uint32_t Slot(uint64_t match) { return __builtin_ctzll(match) / 8; }
+};
+
+static const ObjectMethodTable *HashTableVTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
 }
 
-static bool HashNodeEquals(const HeapObject *n1, const HeapObject *n2) {
-    const HashNode *node1 = HeapObject::Cast<HashNode>(n1),
-                   *node2 = HeapObject::Cast<HashNode>(n2);
-    return HeapObject::Equals(node1->key(), node2->key()) &&
-        HeapObject::Equals(node1->value(), node2->value());
+HashTable *HashTable::Create(uint32_t capacity) {
+    assert(capacity != 0 && "empty hash table");
+    assert((capacity & (capacity - 1)) == 0 && "capacity not power of two");
+    assert(
+        (!IsSmall(capacity) || capacity <= sizeof(uint64_t)) &&
+        "small table wider than a word");
+
+    HashTable *table = Allocate<HashTable>(Size(capacity));
+    Init(table, capacity);
+    return table;
 }
 
-static ObjectMethodTable *HashNodeVTable() {
-    static ObjectMethodTable table = {
-        &HashNodeEquals,
-        nullptr,
-        &Children,
-    };
-    return &table;
+void HashTable::Init(HashTable *table, uint32_t capacity) {
+    table->set_type(kHashTable);
+    table->set_vtable(HashTableVTable());
+    table->set_capacity(capacity);
+    table->set_size(0);
+    table->set_deleted(0);
+
+    Element *slots = table->GetArrayFieldAs<Element, kSlots>();
+    for (uint32_t i = 0; i < capacity * 2; ++i) slots[i] = Nil::Create();
+    memset(table->control(), kEmpty, capacity);
 }
 
-HashNode *HashNode::Create(const RawObject *key, Element value, Element next) {
-    HashNode *node = Allocate<HashNode>(Size());
-    node->set_key(key);
-    node->set_value(value);
-    node->set_next(next);
-    node->set_vtable(HashNodeVTable());
-    node->set_type(kHashNode);
-    return node;
+int32_t HashTable::Lookup(const RawObject *key, uint32_t hash) const {
+    const uint8_t *control = this->control();
+    if (IsSmall()) {
+        uint64_t word = SmallGroup::Load(control, capacity());
+        for (uint64_t match = SmallGroup::Match(word, H2(hash)); match;
+             match &= match - 1) {
+            uint32_t slot = SmallGroup::Slot(match);
+            if (HeapObject::Equals(this->key(slot), key)) return slot;
+        }
+        return kNotFound;
+    }
+
+    uint32_t mask = capacity() / kGroupWidth - 1;
+    uint32_t group = H1(hash) & mask;
+    uint8_t h2 = H2(hash);
+
+    // Triangular probing visits every group once.
+    for (uint32_t i = 1; i <= mask + 1; ++i) {
+        const uint8_t *ctrl = control + group * kGroupWidth;
+        for (uint32_t match = Group::Match(ctrl, h2); match;
+             match &= match - 1) {
+            uint32_t slot = group * kGroupWidth + LowestBit(match);
+            if (HeapObject::Equals(this->key(slot), key)) return slot;
+        }
+        if (Group::MatchEmpty(ctrl)) break;
+        group = (group + i) & mask;
+    }
+    return kNotFound;
 }
 
-void HashNode::Children(const ForwardingCallback &cb) {
-    const RawObject *key = this->key();
-    RawObject *value = this->value();
-    RawObject *next = this->next();
+uint32_t HashTable::Insert(const RawObject *key, uint32_t hash, Element value) {
+    uint8_t *control = this->control();
+    if (IsSmall()) {
+        uint64_t word = SmallGroup::Load(control, capacity());
+        uint64_t match = SmallGroup::MatchEmpty(word);
+        uint32_t slot = SmallGroup::Slot(match);
+        if (match == 0 || slot >= capacity())
+            throw std::logic_error("insert into a full hash table");
+
+        control[slot] = H2(hash);
+        set_key(slot, key);
+        set_value(slot, value);
+        set_size(size() + 1);
+        return slot;
+    }
 
-    if (key->IsObject())
-        key = ForwardingObject<HeapObject>(cb, HeapObject::From(key));
+    uint32_t mask = capacity() / kGroupWidth - 1;
+    uint32_t group = H1(hash) & mask;
+
+    for (uint32_t i = 1; i <= mask + 1; ++i) {
+        const uint8_t *ctrl = control + group * kGroupWidth;
+        uint32_t match = Group::MatchEmptyOrDeleted(ctrl);
+        if (match) {
+            uint32_t slot = group * kGroupWidth + LowestBit(match);
+            if (control[slot] == kTombstone) set_deleted(deleted() - 1);
+            control[slot] = H2(hash);
+            set_key(slot, key);
+            set_value(slot, value);
+            set_size(size() + 1);
+            return slot;
+        }
+        group = (group + i) & mask;
+    }
+
+    throw std::logic_error("insert into a full hash table");
+}
 
-    if (value->IsObject())
-        value = ForwardingObject<HeapObject>(cb, HeapObject::From(value));
+void HashTable::Erase(uint32_t slot) {
+    assert(IsFull(slot) && "erase an empty slot");
 
-    if (next->IsObject())
-        next = ForwardingObject<HeapObject>(cb, HeapObject::From(next));
+    // If the group still has an empty slot, every probe stops in this group,
+    // so the slot could be reused as empty instead of a tombstone. Small
+    // tables never probe.
+    uint8_t *control = this->control();
+    const uint8_t *ctrl = control + slot / kGroupWidth * kGroupWidth;
+    if (IsSmall() || Group::MatchEmpty(ctrl)) {
+        control[slot] = kEmpty;
+    } else {
+        control[slot] = kTombstone;
+        set_deleted(deleted() + 1);
+    }
 
-    set_key(key);
-    set_value(value);
-    set_next(next);
+    set_key(slot, Nil::Create());
+    set_value(slot, Nil::Create());
+    set_size(size() - 1);
 }
 
-static void HashMapChildren(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception");
+/**
+ * Shapes are keyed by `ShortString`, so a string key short enough is read into
+ * one whatever its representation, and finds the same slot.
+ */
+static const RawObject *ShapeKey(const RawObject *key) {
+    if (key->IsShortString() || !String::IsString(key)) return key;
 
-    HashMap *map = HeapObject::Cast<HashMap>(obj);
-    map->Children(cb);
+    uint32_t length = String::LengthOf(key);
+    if (!ShortString::Fits(length)) return key;
+
+    // Reading a rope doesn't allocate.
+    char buf[ShortString::kMaxLength];
+    for (uint32_t i = 0; i < length; ++i) buf[i] = String::CharAt(key, i);
+    return ShortString::Create(buf, length);
 }
 
 static const ObjectMethodTable *HashMapVTable() {
-    static ObjectMethodTable table = {nullptr, nullptr, &HashMapChildren};
+    static ObjectMethodTable table = {nullptr, nullptr};
     return &table;
 }
 
-HashMap *HashMap::Create() {
-    const size_t length = 16;
+HashMap *HashMap::Create(uint32_t narray, uint32_t nhash) {
     const double load_factor = 0.75;
-    size_t size = sizeof(double) + sizeof(uint32_t) + sizeof(Array *);
-
-    HeapObject *obj = Allocate<HeapObject>(size);
-
-    GCInterface *gc = Context::gc();
-    gc->Push(&obj);
-    Array *buckets = Array::Create(length);
-    gc->Pop();
+    size_t size = sizeof(double) + sizeof(uint32_t) * 2 + sizeof(uintptr_t) +
+        sizeof(HashTable *) * 2 + sizeof(Element) * 3;
 
-    HashMap *map = Cast<HashMap>(obj);
+    HashMap *map = Allocate<HashMap>(size);
     map->set_length(0);
     map->set_load_factor(load_factor);
-    map->set_buckets(buckets);
+    map->set_migrated(0);
+    map->set_array_count(0);
+    map->set_table(Nil::Create());
+    map->set_old_table(Nil::Create());
+    map->set_shape(Nil::Create());
+    map->set_values(Nil::Create());
+    map->set_array(Nil::Create());
     map->set_type(kHashMap);
     map->set_vtable(HashMapVTable());
 
-    return map;
+    // Empty map is shaped, neither table nor values are allocated. The root
+    // shape lives in old space and may move while allocating the map, so it
+    // is read afterwards; its first use creates it, which may move the map.
+    HeapObject *obj = map;
+    GCInterface *gc = Context::gc();
+    gc->Push(&obj);
+    Shape *root = Shape::Root();
+    Cast<HashMap>(obj)->set_shape(root);
+
+    narray = std::min<uint32_t>(narray, kMaxArray);
+    nhash = std::min<uint32_t>(nhash, Shape::kMaxKeys);
+
+    // Literal keys are expected to be strings, so the hash part is presized
+    // in shaped mode.
+    if (narray != 0) {
+        Array *array = Array::Create(narray);
+        Cast<HashMap>(obj)->set_array(array);
+    }
+    if (nhash != 0) {
+        Array *values = Array::Create(std::max<uint32_t>(nhash, kMinSlots));
+        Cast<HashMap>(obj)->set_values(values);
+    }
+    gc->Pop();
+
+    return Cast<HashMap>(obj);
 }
 
 void HashMap::Set(const RawObject *key, Element value) {
     if (value->IsNil()) {
         Remove(key);
-    } else {
-        SetWithoutUpdate(key, value);
-        Update();
+        return;
+    }
+
+    uint32_t idx, capacity;
+    if (ArrayIndex(key, &idx)) {
+        StoreInArray(idx, value);
+        return;
+    }
+
+    if (ShouldGrowArray(key, &capacity)) {
+        HeapObject *self = this;
+        HeapObject *held = value->IsObject() ? From(value) : nullptr;
+        GCInterface *gc = Context::gc();
+        gc->Push(&self);
+        if (held) gc->Push(&held);
+        GrowArray(capacity);
+        if (held) {
+            gc->Pop();
+            value = held;
+        }
+        gc->Pop();
+
+        Cast<HashMap>(self)->StoreInArray(key->As<Fixnum>()->value(), value);
+        return;
+    }
+
+    if (IsShaped()) {
+        if (SetShaped(key, value)) return;
+
+        // Converting allocates the table, `key` may be a heap string, then
+        // set it in dictionary mode.
+        HeapObject *self = this;
+        HeapObject *held_key =
+            key->IsObject() ? const_cast<HeapObject *>(From(key)) : nullptr;
+        HeapObject *held = value->IsObject() ? From(value) : nullptr;
+        GCInterface *gc = Context::gc();
+        gc->Push(&self);
+        if (held_key) gc->Push(&held_key);
+        if (held) gc->Push(&held);
+        ToDictionary();
+        if (held) {
+            gc->Pop();
+            value = held;
+        }
+        if (held_key) {
+            gc->Pop();
+            key = held_key;
+        }
+        gc->Pop();
+
+        Cast<HashMap>(self)->Set(key, value);
+        return;
+    }
+
+    Migrate(kMigrateSlots);
+
+    uint32_t hash = HeapObject::HashCode(key);
+    HashTable *table = this->table();
+    int32_t slot = table->Lookup(key, hash);
+    if (slot != HashTable::kNotFound) {
+        table->set_value(slot, value);
+        return;
+    }
+
+    if (IsMigrating()) {
+        // Not migrated yet, move it into new table.
+        HashTable *old_table = this->old_table();
+        slot = old_table->Lookup(key, hash);
+        if (slot != HashTable::kNotFound) {
+            old_table->Erase(slot);
+            table->Insert(key, hash, value);
+            return;
+        }
     }
+
+    // The table always keeps a free slot, so insert before growing, and
+    // neither `key` nor `value` is held across allocation.
+    table->Insert(key, hash, value);
+    set_length(length() + 1);
+    Update();
 }
 
 HeapObject::Element HashMap::Find(const RawObject *key) {
-    Element link = GetHashNodeLink(key);
-    while (!link->IsNil()) {
-        HeapObject *obj = HeapObject::From(link);
-        HashNode *node = Cast<HashNode>(obj);
-        if (HeapObject::Equals(node->key(), key)) return node->value();
-        link = node->next();
+    uint32_t idx;
+    if (ArrayIndex(key, &idx)) return array()->Get(idx);
+
+    if (IsShaped()) {
+        int32_t slot = SlotOf(key);
+        if (slot == Shape::kNotFound) return Nil::Create();
+        return values()->Get(slot);
+    }
+
+    Migrate(kMigrateSlots);
+
+    uint32_t hash = HeapObject::HashCode(key);
+    HashTable *table = this->table();
+    int32_t slot = table->Lookup(key, hash);
+    if (slot != HashTable::kNotFound) return table->value(slot);
+
+    if (IsMigrating()) {
+        table = old_table();
+        slot = table->Lookup(key, hash);
+        if (slot != HashTable::kNotFound) return table->value(slot);
     }
     return Nil::Create();
 }
 
 void HashMap::Remove(const RawObject *key) {
-    RawObject *link = GetHashNodeLink(key);
-    if (link->IsNil()) return;
-
-    HeapObject *obj = HeapObject::From(link);
-    HashNode *node = Cast<HashNode>(obj);
-    if (HeapObject::Equals(node->key(), key)) {
-        SetHashNodeLink(key, node->next());
+    uint32_t idx;
+    if (ArrayIndex(key, &idx)) {
+        // The array part is refitted on rehash, not on removal.
+        Array *array = this->array();
+        if (array->Get(idx)->IsNil()) return;
+        array->Set(idx, Nil::Create());
+        set_array_count(array_count() - 1);
+        set_length(length() - 1);
         return;
     }
 
-    while (true) {
-        RawObject *object = node->next();
-        if (object->IsNil()) return;
-        HashNode *next = Cast<HashNode>(From(object));
-        if (HeapObject::Equals(next->key(), key)) {
-            node->set_next(next->next());
+    if (IsShaped()) {
+        int32_t slot = SlotOf(key);
+        if (slot == Shape::kNotFound) return;
+
+        Shape *shape = current_shape();
+        if (static_cast<uint32_t>(slot) + 1 == shape->count()) {
+            // The last added key, step back to parent shape.
+            values()->Set(slot, Nil::Create());
+            set_shape(shape->parent());
+            set_length(length() - 1);
             return;
         }
-        node = next;
+
+        HeapObject *self = this;
+        HeapObject *held_key =
+            key->IsObject() ? const_cast<HeapObject *>(From(key)) : nullptr;
+        GCInterface *gc = Context::gc();
+        gc->Push(&self);
+        if (held_key) gc->Push(&held_key);
+        ToDictionary();
+        if (held_key) {
+            gc->Pop();
+            key = held_key;
+        }
+        gc->Pop();
+
+        Cast<HashMap>(self)->Remove(key);
+        return;
     }
+
+    Migrate(kMigrateSlots);
+
+    uint32_t hash = HeapObject::HashCode(key);
+    HashTable *table = this->table();
+    int32_t slot = table->Lookup(key, hash);
+    if (slot == HashTable::kNotFound && IsMigrating()) {
+        table = old_table();
+        slot = table->Lookup(key, hash);
+    }
+    if (slot == HashTable::kNotFound) return;
+
+    table->Erase(slot);
+    set_length(length() - 1);
+    Update();
 }
 
-void HashMap::SetWithoutUpdate(const RawObject *key, Element value) {
-    RawObject *link = GetHashNodeLink(key), *start = link;
+bool HashMap::Next(uint32_t *cursor, Element *key, Element *value) {
+    uint32_t pos = *cursor;
+    uint32_t array_capacity = this->array_capacity();
+    for (; pos < array_capacity; ++pos) {
+        Element e = array()->Get(pos);
+        if (e->IsNil()) continue;
+        *key = Fixnum::Create(static_cast<int32_t>(pos));
+        *value = e;
+        *cursor = pos + 1;
+        return true;
+    }
 
-    while (!link->IsNil()) {
-        HashNode *node = Cast<HashNode>(From(link));
-        if (HeapObject::Equals(key, node->key())) {
-            node->set_value(value);
-            return;
-        }
-        link = node->next();
+    uint32_t slot = pos - array_capacity;
+    if (IsShaped()) {
+        Shape *shape = current_shape();
+        if (slot >= shape->count()) return false;
+
+        // Slot `i` is keyed by the ancestor holding `i + 1` keys.
+        while (shape->count() > slot + 1) shape = shape->parent();
+        *key = shape->key();
+        *value = values()->Get(slot);
+        *cursor = pos + 1;
+        return true;
+    }
+
+    // Keys move between tables during migration, walk a single table.
+    if (IsMigrating()) Migrate(old_table()->capacity());
+
+    HashTable *table = this->table();
+    for (uint32_t capacity = table->capacity(); slot < capacity; ++slot) {
+        if (!table->IsFull(slot)) continue;
+        *key = table->key(slot);
+        *value = table->value(slot);
+        *cursor = array_capacity + slot + 1;
+        return true;
     }
+    return false;
+}
+
+int32_t HashMap::SlotOf(const RawObject *key) const {
+    if (!IsShaped()) return Shape::kNotFound;
+    key = ShapeKey(key);
+    if (!Shape::IsValidKey(key)) return Shape::kNotFound;
 
-    // Arrived here, indicating that there is no node with key,
-    // to create it
-    HashNode *node =
-        HashNode::Create(const_cast<RawObject *>(key), value, start);
-    SetHashNodeLink(key, node);
+    const Shape *shape = GetFieldAs<const Shape *, kShape>();
+    return shape->Lookup(key);
+}
+
+bool HashMap::SetShaped(const RawObject *key, Element value) {
+    key = ShapeKey(key);
+    int32_t slot = SlotOf(key);
+    if (slot != Shape::kNotFound) {
+        values()->Set(slot, value);
+        return true;
+    }
+
+    uint32_t count = current_shape()->count();
+    if (!Shape::IsValidKey(key) || count >= Shape::kMaxKeys) return false;
+    // Checked before allocating, the caller still holds `value` unrooted.
+    if (!current_shape()->CanTransition(key)) return false;
+
+    // `key` is a ShortString, not a heap object, but both reserving slots
+    // and the transition allocate, which may move this map and `value`.
+    HeapObject *self = this;
+    HeapObject *held = value->IsObject() ? From(value) : nullptr;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    if (held) gc->Push(&held);
+    ReserveSlots(count + 1);
+    Shape *shape = Cast<HashMap>(self)->current_shape()->Transition(key);
+    if (held) {
+        gc->Pop();
+        value = held;
+    }
+    gc->Pop();
+
+    HashMap *map = Cast<HashMap>(self);
+    map->set_shape(shape);
+    map->values()->Set(count, value);
+    map->set_length(map->length() + 1);
+    return true;
+}
+
+void HashMap::ReserveSlots(uint32_t slots) {
+    Element values = GetFieldAs<Element, kValues>();
+    uint32_t capacity = values->IsNil() ? 0 : this->values()->length();
+    if (slots <= capacity) return;
+
+    uint32_t new_capacity = std::max<uint32_t>(kMinSlots, capacity * 2);
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    Array *new_values = Array::Create(new_capacity);
+    gc->Pop();
+
+    HashMap *map = Cast<HashMap>(self);
+    for (uint32_t i = 0; i < capacity; ++i)
+        new_values->Set(i, map->values()->Get(i));
+    map->set_values(new_values);
+}
+
+void HashMap::ToDictionary() {
+    assert(IsShaped() && "already in dictionary mode");
+
+    uint32_t capacity = kMinCapacity;
+    while (capacity * load_factor() <= hash_length()) capacity *= 2;
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    HashTable *table = HashTable::Create(capacity);
+    gc->Pop();
+
+    // Shape keys are ShortStrings, hashing them never allocates.
+    HashMap *map = Cast<HashMap>(self);
+    Shape *shape = map->current_shape();
+    for (; !shape->IsRoot(); shape = shape->parent()) {
+        const RawObject *key = shape->key();
+        uint32_t hash = HeapObject::HashCode(key);
+        table->Insert(key, hash, map->values()->Get(shape->count() - 1));
+    }
+
+    map->set_table(table);
+    map->set_shape(Nil::Create());
+    map->set_values(Nil::Create());
+}
+
+bool HashMap::ArrayIndex(const RawObject *key, uint32_t *idx) const {
+    if (!key->IsFixnum()) return false;
+
+    int32_t value = key->As<Fixnum>()->value();
+    if (value < 0 || static_cast<uint32_t>(value) >= array_capacity())
+        return false;
+    *idx = static_cast<uint32_t>(value);
+    return true;
+}
+
+bool HashMap::ShouldGrowArray(const RawObject *key, uint32_t *capacity) const {
+    if (!key->IsFixnum()) return false;
+
+    int32_t value = key->As<Fixnum>()->value();
+    uint32_t new_capacity = std::max<uint32_t>(kMinArray, array_capacity() * 2);
+    if (value < 0 || static_cast<uint32_t>(value) >= new_capacity ||
+        new_capacity > kMaxArray)
+        return false;
+
+    // Appending keeps more than half of [0, key] in the array part.
+    uint32_t idx = static_cast<uint32_t>(value);
+    if ((array_count() + 1) * 2 <= idx + 1) return false;
+
+    *capacity = new_capacity;
+    return true;
+}
+
+void HashMap::StoreInArray(uint32_t idx, Element value) {
+    Array *array = this->array();
+    if (array->Get(idx)->IsNil()) {
+        set_array_count(array_count() + 1);
+        set_length(length() + 1);
+    }
+    array->Set(idx, value);
+}
+
+void HashMap::GrowArray(uint32_t capacity) {
+    uint32_t old_capacity = array_capacity();
+    assert(old_capacity < capacity && "array part can't grow");
+
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    Array *array = Array::Create(capacity);
+    gc->Pop();
+
+    HashMap *map = Cast<HashMap>(self);
+    for (uint32_t i = 0; i < old_capacity; ++i)
+        array->Set(i, map->array()->Get(i));
+    map->set_array(array);
+
+    // Shaped hash part holds no Fixnum key.
+    if (map->IsShaped()) return;
+    map->MoveToArray(map->table(), old_capacity);
+    if (map->IsMigrating()) map->MoveToArray(map->old_table(), old_capacity);
+}
+
+void HashMap::MoveToArray(HashTable *table, uint32_t begin) {
+    uint32_t end = array_capacity();
+    uint32_t capacity = table->capacity();
+    for (uint32_t i = 0; i < capacity && table->size() != 0; ++i) {
+        if (!table->IsFull(i) || !table->key(i)->IsFixnum()) continue;
+
+        int32_t idx = table->key(i)->As<Fixnum>()->value();
+        if (idx < static_cast<int32_t>(begin) ||
+            idx >= static_cast<int32_t>(end))
+            continue;
+
+        array()->Set(idx, table->value(i));
+        table->Erase(i);
+        set_array_count(array_count() + 1);
+    }
+}
+
+void HashMap::ShrinkArray(uint32_t capacity) {
+    assert(!IsShaped() && !IsMigrating() && "can't move keys to hash part");
+
+    uint32_t old_capacity = array_capacity();
+    uint32_t moved = 0;
+    for (uint32_t i = capacity; i < old_capacity; ++i) {
+        if (!array()->Get(i)->IsNil()) ++moved;
+    }
+
+    // Moved keys go to the new table, sized for all keys of hash part.
+    uint32_t table_capacity = this->capacity();
+    while (table_capacity * load_factor() <= hash_length() + moved)
+        table_capacity *= 2;
+
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    Rehash(table_capacity);
+    Element array = Nil::Create();
+    if (capacity != 0) array = Array::Create(capacity);
+    gc->Pop();
+
+    HashMap *map = Cast<HashMap>(self);
+    if (capacity != 0) {
+        Array *new_array = Cast<Array>(From(array));
+        for (uint32_t i = 0; i < capacity; ++i)
+            new_array->Set(i, map->array()->Get(i));
+    }
+
+    HashTable *table = map->table();
+    for (uint32_t i = capacity; i < old_capacity; ++i) {
+        Element value = map->array()->Get(i);
+        if (value->IsNil()) continue;
+        RawObject *key = Fixnum::Create(static_cast<int32_t>(i));
+        table->Insert(key, HeapObject::HashCode(key), value);
+    }
+
+    map->set_array(array);
+    map->set_array_count(map->array_count() - moved);
+}
+
+static uint32_t ArrayBucket(uint32_t idx) {
+    // bucket i counts keys in [2^(i-1), 2^i), bucket 0 counts key 0.
+    return idx == 0 ? 0 : 32 - __builtin_clz(idx);
+}
+
+/**
+ * Like Lua's `computesizes`, the array part is the largest power of two `n`
+ * such that more than half of [0, n) are used.
+ */
+uint32_t HashMap::ComputeArraySize() {
+    uint32_t nums[kMaxArrayBits + 1] = {0};
+
+    uint32_t old_capacity = array_capacity();
+    for (uint32_t i = 0; i < old_capacity; ++i) {
+        if (!array()->Get(i)->IsNil()) ++nums[ArrayBucket(i)];
+    }
+
+    const HashTable *table = this->table();
+    uint32_t table_capacity = table->capacity();
+    for (uint32_t i = 0; i < table_capacity; ++i) {
+        if (!table->IsFull(i) || !table->key(i)->IsFixnum()) continue;
+        int32_t idx = table->key(i)->As<Fixnum>()->value();
+        if (idx >= 0 && idx < kMaxArray) ++nums[ArrayBucket(idx)];
+    }
+
+    uint32_t total = 0, size = 0;
+    for (uint32_t i = 0; i <= kMaxArrayBits; ++i) {
+        total += nums[i];
+        if (total * 2 > (1u << i)) size = 1u << i;
+    }
+    return size;
+}
+
+void HashMap::Rebalance() {
+    assert(!IsShaped() && !IsMigrating() && "rebalance during migration");
+
+    uint32_t capacity = ComputeArraySize();
+    uint32_t old_capacity = array_capacity();
+    if (capacity > old_capacity)
+        GrowArray(capacity);
+    else if (capacity < old_capacity)
+        ShrinkArray(capacity);
 }
 
 void HashMap::Update() {
-    if (IsNeedExpand())
-        Expand();
-    else if (IsNeedShrink())
+    if (IsMigrating()) {
+        // New table is going to be full before old one drained, finish the
+        // migration now, it is rare since new table is sized for all keys.
+        if (!IsNeedExpand()) return;
+        Migrate(old_table()->capacity());
+    }
+
+    if (IsNeedExpand()) {
+        // Like Lua's rehash, refit the array part first, moving integer keys
+        // may leave nothing to expand.
+        HeapObject *self = this;
+        GCInterface *gc = Context::gc();
+        gc->Push(&self);
+        Rebalance();
+        gc->Pop();
+
+        HashMap *map = Cast<HashMap>(self);
+        if (!map->IsMigrating() && map->IsNeedExpand()) map->Expand();
+    } else if (IsNeedShrink()) {
         Shrink();
+    }
 }
 
 void HashMap::Rehash(size_t capacity) {
-    Array *old_buckets = buckets();
-    Array *new_buckets = Array::Create(capacity);
-
-    set_buckets(new_buckets);
-
-    size_t length = old_buckets->length();
-    for (size_t i = 0; i < length; ++i) {
-        RawObject *link = old_buckets->Get(i);
-        while (!link->IsNil()) {
-            HashNode *node = Cast<HashNode>(From(link));
-            link = node->next();
-
-            RawObject *target_key = node->key();
-            RawObject *target_link = GetHashNodeLink(target_key);
-            node->set_next(target_link);
-            SetHashNodeLink(target_key, node);
-        }
+    assert(!IsMigrating() && "rehash during migration");
+
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    HashTable *new_table = HashTable::Create(capacity);
+    gc->Pop();
+
+    HashMap *map = Cast<HashMap>(self);
+    HashTable *old_table = map->table();
+    map->set_table(new_table);
+    map->set_old_table(old_table);
+    map->set_migrated(0);
+}
+
+void HashMap::Migrate(uint32_t slots) {
+    if (!IsMigrating()) return;
+
+    HashTable *old_table = this->old_table();
+    HashTable *new_table = table();
+    uint32_t old_capacity = old_table->capacity();
+    uint32_t begin = migrated();
+    uint32_t end = std::min(old_capacity, begin + slots);
+    for (uint32_t i = begin; i < end && old_table->size() != 0; ++i) {
+        if (!old_table->IsFull(i)) continue;
+        RawObject *key = old_table->key(i);
+        uint32_t hash = HeapObject::HashCode(key);
+        new_table->Insert(key, hash, old_table->value(i));
+        old_table->Erase(i);
+    }
+
+    if (end == old_capacity || old_table->size() == 0) {
+        set_old_table(Nil::Create());
+        set_migrated(0);
+    } else {
+        set_migrated(end);
     }
 }
 
 void HashMap::Expand() {
-    size_t cap = capacity() * 2;
-    Rehash(cap);
+    // Mostly tombstones, rehash in place to purge them.
+    size_t thresold = Threshold();
+    if (hash_length() * 2 < thresold) {
+        Rehash(capacity());
+    } else {
+        Rehash(capacity() * 2);
+    }
 }
 
 void HashMap::Shrink() {
@@ -195,41 +817,28 @@ void HashMap::Shrink() {
     Rehash(cap);
 }
 
-bool HashMap::IsNeedExpand() {
-    size_t thresold = load_factor() * capacity();
-
-    return thresold <= length();
-}
-
-bool HashMap::IsNeedShrink() {
-    size_t thresold = (1.0 - load_factor()) * capacity();
-    return capacity() != 16 && thresold > length();
+size_t HashMap::Threshold() const {
+    // Small tables are scanned linearly, fill them up.
+    if (table()->IsSmall()) return capacity();
+    return load_factor() * capacity();
 }
 
-RawObject *HashMap::GetHashNodeLink(const RawObject *key) {
-    uint32_t hash = HeapObject::HashCode(key) & capacity();
-
-    return buckets()->Get(hash);
+bool HashMap::IsNeedExpand() {
+    size_t thresold = Threshold();
+    const HashTable *table = this->table();
+    return thresold <= table->size() + table->deleted();
 }
 
-void HashMap::SetHashNodeLink(const RawObject *key, Element link) {
-    size_t hash = HeapObject::HashCode(key) % capacity();
-
-    buckets()->Set(hash, link);
+bool HashMap::IsNeedShrink() {
+    return capacity() > kMinCapacity &&
+        hash_length() * kShrinkRatio < capacity();
 }
 
 void HashMap::ValidateKeyType(const RawObject *key) {
-    if (!key->IsFixnum() ||
-        !(key->IsObject() && HeapObject::From(key)->IsString())) {
+    if (!key->IsFixnum() && !String::IsString(key)) {
         throw std::runtime_error("only support Fixnum & String");
     }
 }
 
-void HashMap::Children(const ForwardingCallback &cb) {
-    Array *buckets = this->buckets();
-    buckets = ForwardingObject<Array>(cb, buckets);
-    set_buckets(buckets);
-}
-
 } // namespace object
 } // namespace nrk
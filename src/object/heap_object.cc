@@ -1,6 +1,12 @@
 #include <nerangake/object/heap_object.h>
 
+#include <string.h> // memmove
+
+#include <algorithm>
+
 #include <nerangake/context.h>
+#include <nerangake/object/string.h>
+#include <nerangake/object/visitor.h>
 
 namespace nrk {
 namespace object {
@@ -24,7 +30,6 @@ static ObjectMethodTable *DefaultObjectMethodTable() {
     static ObjectMethodTable table = {
         &DefaultEquals,
         &DefaultHashCode,
-        nullptr,
     };
     return &table;
 }
@@ -54,16 +59,81 @@ HeapObject *HeapObject::StaticDef(size_t size) {
     return object;
 }
 
-void HeapObject::SetFieldInternal(RawObject **field, HeapObject *obj) {
+bool HeapObject::concurrent_marking_ = false;
+
+HeapObject *HeapObject::CreateFiller(void *address, size_t size) {
+    assert(size >= sizeof(uint64_t) && "filler smaller than a word");
+
+    HeapObject *filler = reinterpret_cast<HeapObject *>(address);
+    filler->At<uint8_t, kAge>() = 0;
+    filler->set_size(static_cast<uint32_t>(size));
+    filler->set_type(kFiller);
+    return filler;
+}
+
+void HeapObject::SetFieldInternal(RawObject **field, RawObject *obj) {
+    using gc::GCInterface;
+
+    GCInterface *gc = Context::gc();
+    // Snapshot at the beginning: the reference overwritten is reported to
+    // the marker before it is lost.
+    if (concurrent_marking_) gc->PreWriteBarrier(this, field, 1);
+
+    if (obj->IsObject())
+        gc->WriteBarrier(this, field, HeapObject::From(obj));
+    else
+        __atomic_store_n(field, obj, __ATOMIC_RELAXED);
+}
+
+void HeapObject::PreWriteBarrierRange(RawObject **fields, size_t count) {
     using gc::GCInterface;
 
+    if (!concurrent_marking_ || count == 0) return;
     GCInterface *gc = Context::gc();
-    gc->WriteBarrier(this, field, obj);
+    gc->PreWriteBarrier(this, fields, count);
+}
+
+void HeapObject::MoveSlots(
+    RawObject **dst, RawObject *const *src, size_t count) {
+    if (!concurrent_marking_) {
+        memmove(dst, src, count * sizeof(RawObject *));
+        return;
+    }
+
+    if (dst <= src) {
+        for (size_t i = 0; i < count; ++i)
+            __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+    } else {
+        for (size_t i = count; i > 0; --i)
+            __atomic_store_n(&dst[i - 1], src[i - 1], __ATOMIC_RELAXED);
+    }
+}
+
+void HeapObject::FillSlots(RawObject **dst, RawObject *obj, size_t count) {
+    if (!concurrent_marking_) {
+        std::fill(dst, dst + count, obj);
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        __atomic_store_n(&dst[i], obj, __ATOMIC_RELAXED);
+}
+
+void HeapObject::WriteBarrierRange(RawObject **fields, size_t count) {
+    using gc::GCInterface;
+
+    if (count == 0) return;
+    GCInterface *gc = Context::gc();
+    gc->WriteBarrierRange(this, fields, count);
 }
 
 bool HeapObject::Equals(const RawObject *key1, const RawObject *key2) {
     if (key1 == key2) return true;
 
+    // `String`, `ShortString` and `Rope` are compared by content.
+    if (String::IsString(key1) && String::IsString(key2))
+        return String::Equals(key1, key2);
+
     if (key1->IsObject() && key2->IsObject()) {
         // must be heap object.
         const HeapObject *o1 = HeapObject::From(key1);
@@ -90,17 +160,15 @@ uint32_t HeapObject::HashCode(const RawObject *key) {
         } else {
             return table->hash_code(object);
         }
+    } else if (key->IsShortString()) {
+        return String::HashCode(key);
     } else {
         return HashValue(key);
     }
 }
 
 void HeapObject::Children(HeapObject *obj, const ForwardingCallback &cb) {
-    const ObjectMethodTable *vtable = obj->vtable();
-    // some HeapObjects haven't any child, so `process_children` will be
-    // nullptr.
-    if (vtable->process_children == nullptr)
-        DefaultObjectMethodTable()->process_children(obj, cb);
+    VisitPointers(obj, cb);
 }
 
 } // namespace object
@@ -0,0 +1,23 @@
+#include <nerangake/object/packed_array.h>
+
+#include <string.h> // memset
+
+namespace nrk {
+namespace object {
+
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
+PackedArray *PackedArray::Create(uint32_t length) {
+    PackedArray *array = Allocate<PackedArray>(Size(length));
+    array->set_type(kPackedArray);
+    array->set_vtable(VTable());
+    array->set_length(length);
+    memset(array->ints(), 0, length * sizeof(int64_t));
+    return array;
+}
+
+} // namespace object
+} // namespace nrk
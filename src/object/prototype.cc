@@ -2,11 +2,18 @@
 
 #include <assert.h>
 
+#include <stdexcept>
+
 namespace nrk {
 namespace object {
 
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
 size_t Prototype::Size(uint16_t num_of_captured) {
-    return sizeof(int32_t) + sizeof(uint32_t) + sizeof(uintptr_t) +
+    return sizeof(int32_t) + sizeof(uint32_t) + sizeof(uintptr_t) * 2 +
         sizeof(Captured) * num_of_captured;
 }
 
@@ -18,6 +25,8 @@ Prototype *Prototype::Create(
     size_t size = Size(captureds.size());
     Prototype *proto = Static<Prototype>(size);
     proto->set_type(kPrototype);
+    proto->set_vtable(VTable());
+    proto->SetField<kSwitchTables>(Nil::Create());
     proto->set_code(code);
     proto->set_size_of_code(size_of_code);
     proto->set_num_of_params(num_of_params);
@@ -56,6 +65,33 @@ const Captured &Prototype::captured(unsigned idx) const {
     return captureds[idx];
 }
 
+uint32_t Prototype::num_of_switch_tables() const {
+    const Element tables = GetFieldAs<Element, kSwitchTables>();
+    return tables->IsNil() ? 0 : Cast<Array>(From(tables))->length();
+}
+
+const SwitchTable *Prototype::switch_table(unsigned idx) const {
+    if (idx >= num_of_switch_tables())
+        throw std::runtime_error("switch table not found");
+
+    const Array *tables = GetFieldAs<Array *, kSwitchTables>();
+    const Element table = tables->Get(idx);
+    assert(table->IsObject() && From(table)->IsSwitchTable());
+    return Cast<SwitchTable>(From(table));
+}
+
+void Prototype::set_switch_tables(Array *tables) {
+    assert(tables && "nullptr exception");
+
+    uint32_t length = tables->length();
+    for (uint32_t i = 0; i < length; ++i) {
+        const Element table = tables->Get(i);
+        if (!table->IsObject() || !From(table)->IsSwitchTable())
+            throw std::runtime_error("switch table expected");
+    }
+    SetField<kSwitchTables>(tables);
+}
+
 void Prototype::set_code(const uint8_t *code) { SetField<kCode>(code); }
 
 void Prototype::set_size_of_code(uint32_t codesize) {
@@ -36,6 +36,35 @@ RawObject* RawObject::Not(const RawObject* val) {
     return Boolean::Create(!RawObject::True(val));
 }
 
+/**
+ * Length of String, Vector, TypedArray, or number of keys of HashMap.
+ *
+ * @param val
+ * @return Fixnum
+ */
+RawObject* RawObject::Len(const RawObject* val) {
+    assert(val && "nullptr exception");
+
+    if (String::IsString(val))
+        return Fixnum::Create(static_cast<int32_t>(String::LengthOf(val)));
+
+    if (val->IsObject()) {
+        const HeapObject* obj = HeapObject::From(val);
+        uint32_t length;
+        if (obj->IsVector())
+            length = HeapObject::Cast<Vector>(obj)->length();
+        else if (obj->IsHashMap())
+            length = HeapObject::Cast<HashMap>(obj)->length();
+        else if (obj->IsTypedArray())
+            length = HeapObject::Cast<TypedArray>(obj)->length();
+        else
+            throw std::runtime_error("object has no length");
+        return Fixnum::Create(static_cast<int32_t>(length));
+    }
+
+    throw std::runtime_error("object has no length");
+}
+
 /**
  * Fixnum
  */
@@ -181,7 +210,8 @@ RawObject* RawObject::NE(const RawObject* lhs, const RawObject* rhs) {
 }
 
 /**
- * Index has only a few possible types, Vector, String, HashMap:
+ * Index has only a few possible types, Vector, TypedArray,
+ * String(ShortString, Rope), HashMap:
  * Among them, HashMap supports index as Fixnum and String, The other
  * only support Fixnum.
  *
@@ -192,6 +222,16 @@ RawObject* RawObject::NE(const RawObject* lhs, const RawObject* rhs) {
 RawObject* RawObject::Index(RawObject* object, const RawObject* index) {
     assert(object && index && "nullptr exception");
 
+    if (String::IsString(object)) {
+        int32_t idx;
+        if (index->IsFixnum() && (idx = index->As<Fixnum>()->value()) >= 0) {
+            return Fixnum::Create(
+                String::CharAt(object, static_cast<unsigned>(idx)));
+        } else {
+            throw std::runtime_error("error index");
+        }
+    }
+
     if (object->IsObject()) {
         HeapObject* obj = HeapObject::From(object);
         if (obj->IsHashMap()) {
@@ -202,16 +242,28 @@ RawObject* RawObject::Index(RawObject* object, const RawObject* index) {
             int32_t idx;
             if (index->IsFixnum() &&
                 (idx = index->As<Fixnum>()->value()) >= 0) {
-                return vector->Get(static_cast<unsigned>(idx));
+                unsigned i = static_cast<unsigned>(idx);
+                if (i >= vector->length())
+                    throw std::runtime_error("index out of range.");
+
+                switch (vector->kind()) {
+                    case Vector::kPackedFixnum:
+                        return Fixnum::Create(
+                            static_cast<int32_t>(vector->IntAt(i)));
+                    case Vector::kPackedDouble:
+                        return Float::Create(vector->DoubleAt(i));
+                    default:
+                        return vector->Get(i);
+                }
             } else {
                 throw std::runtime_error("error index");
             }
-        } else if (obj->IsString()) {
-            String* string = HeapObject::Cast<String>(obj);
+        } else if (obj->IsTypedArray()) {
+            TypedArray* array = HeapObject::Cast<TypedArray>(obj);
             int32_t idx;
             if (index->IsFixnum() &&
                 (idx = index->As<Fixnum>()->value()) >= 0) {
-                return Fixnum::Create(string->At(static_cast<unsigned>(idx)));
+                return array->Get(static_cast<uint32_t>(idx));
             } else {
                 throw std::runtime_error("error index");
             }
@@ -222,7 +274,7 @@ RawObject* RawObject::Index(RawObject* object, const RawObject* index) {
 }
 
 /**
- * Set_index has only a few possible types, Vector, HashMap:
+ * Set_index has only a few possible types, Vector, TypedArray, HashMap:
  * Among them, HashMap supports index as Fixnum and String, The other
  * only support Fixnum.
  *
@@ -245,7 +297,37 @@ void RawObject::SetIndex(RawObject* object, const RawObject* index,
             int32_t idx;
             if (index->IsFixnum() &&
                 (idx = index->As<Fixnum>()->value()) >= 0) {
-                vector->Set(static_cast<unsigned>(idx), val);
+                unsigned i = static_cast<unsigned>(idx);
+                Vector::ElementKind kind = vector->kind();
+                if (i < vector->length() && kind != Vector::kGeneric &&
+                    val->IsFixnum()) {
+                    int32_t value = val->As<Fixnum>()->value();
+                    if (kind == Vector::kPackedFixnum)
+                        vector->SetIntAt(i, value);
+                    else
+                        vector->SetDoubleAt(i, value);
+                    return;
+                }
+                if (i < vector->length() && kind == Vector::kPackedDouble &&
+                    Vector::KindOf(val) == Vector::kPackedDouble) {
+                    const Float* f = HeapObject::Cast<Float>(
+                        HeapObject::From(val));
+                    vector->SetDoubleAt(i, f->value());
+                    return;
+                }
+
+                // Slow path, the vector may change its kind.
+                vector->Set(i, val);
+                return;
+            } else {
+                throw std::runtime_error("error index");
+            }
+        } else if (obj->IsTypedArray()) {
+            TypedArray* array = HeapObject::Cast<TypedArray>(obj);
+            int32_t idx;
+            if (index->IsFixnum() &&
+                (idx = index->As<Fixnum>()->value()) >= 0) {
+                array->Set(static_cast<uint32_t>(idx), val);
                 return;
             } else {
                 throw std::runtime_error("error index");
@@ -256,6 +338,55 @@ void RawObject::SetIndex(RawObject* object, const RawObject* index,
     throw std::runtime_error("object not indexable");
 }
 
+/**
+ * Iteration step over String, Vector, TypedArray and HashMap. `cursor` is a
+ * position rather than a pointer, so it stays valid when GC moves `object`.
+ * Keys of String, Vector and TypedArray are indexes.
+ *
+ * @param object    target to iterate.
+ * @param cursor    position to start from, advanced past the key found.
+ * @param key
+ * @param value
+ * @return bool     false if nothing is left.
+ */
+bool RawObject::Next(RawObject* object, uint32_t* cursor, RawObject** key,
+                     RawObject** value) {
+    assert(object && cursor && key && value && "nullptr exception");
+
+    uint32_t idx = *cursor;
+    if (String::IsString(object)) {
+        if (idx >= String::LengthOf(object)) return false;
+        *key = Fixnum::Create(static_cast<int32_t>(idx));
+        *value = Fixnum::Create(String::CharAt(object, idx));
+        *cursor = idx + 1;
+        return true;
+    }
+
+    if (object->IsObject()) {
+        HeapObject* obj = HeapObject::From(object);
+        if (obj->IsHashMap()) {
+            return HeapObject::Cast<HashMap>(obj)->Next(cursor, key, value);
+        } else if (obj->IsVector()) {
+            Vector* vector = HeapObject::Cast<Vector>(obj);
+            if (idx >= vector->length()) return false;
+            *key = Fixnum::Create(static_cast<int32_t>(idx));
+            *cursor = idx + 1;
+            // Boxing a packed double allocates, so do it last.
+            *value = vector->Get(idx);
+            return true;
+        } else if (obj->IsTypedArray()) {
+            TypedArray* array = HeapObject::Cast<TypedArray>(obj);
+            if (idx >= array->length()) return false;
+            *key = Fixnum::Create(static_cast<int32_t>(idx));
+            *cursor = idx + 1;
+            *value = array->Get(idx);
+            return true;
+        }
+    }
+
+    throw std::runtime_error("object not iterable");
+}
+
 /**
  * In addition to the value associated with Boolean, the rest is consistent with
  * NZ().
@@ -0,0 +1,101 @@
+#include <nerangake/object/record.h>
+
+#include <assert.h>
+
+#include <stdexcept>
+
+#include <nerangake/context.h>
+#include <nerangake/object/float.h>
+
+namespace nrk {
+namespace object {
+
+static const ObjectMethodTable *DescriptorVTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
+static const ObjectMethodTable *RecordVTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
+RecordDescriptor *RecordDescriptor::Create(
+    const std::vector<FieldKind> &kinds) {
+    uint32_t count = static_cast<uint32_t>(kinds.size());
+
+    // Descriptors are constants of bytecode, so they live as long as it.
+    RecordDescriptor *descriptor = Static<RecordDescriptor>(Size(count));
+    descriptor->set_type(kRecordDescriptor);
+    descriptor->set_vtable(DescriptorVTable());
+    descriptor->set_count(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (kinds[i] > kDouble) throw std::runtime_error("unknown field kind");
+        descriptor->set_kind(i, kinds[i]);
+    }
+    return descriptor;
+}
+
+Record *Record::Create(RecordDescriptor *descriptor) {
+    assert(descriptor && "nullptr exception");
+
+    HeapObject *held = descriptor;
+    GCInterface *gc = Context::gc();
+    gc->Push(&held);
+    Record *record = Allocate<Record>(Size(descriptor->count()));
+    gc->Pop();
+    descriptor = Cast<RecordDescriptor>(held);
+
+    record->set_type(kRecord);
+    record->set_vtable(RecordVTable());
+    record->set_descriptor(descriptor);
+
+    uint32_t count = descriptor->count();
+    for (uint32_t i = 0; i < count; ++i) {
+        switch (descriptor->kind(i)) {
+            case RecordDescriptor::kFixnum:
+                record->fields()[i] = Fixnum::Create(0);
+                break;
+            case RecordDescriptor::kDouble:
+                record->doubles()[i] = 0.0;
+                break;
+            default:
+                record->fields()[i] = Nil::Create();
+                break;
+        }
+    }
+    return record;
+}
+
+Record::Element Record::Get(uint32_t idx) {
+    if (idx >= count()) throw std::runtime_error("field out of range.");
+
+    if (descriptor()->kind(idx) == RecordDescriptor::kDouble)
+        return Float::Create(doubles()[idx]);
+    return fields()[idx];
+}
+
+void Record::Set(uint32_t idx, Element e) {
+    if (idx >= count()) throw std::runtime_error("field out of range.");
+
+    switch (descriptor()->kind(idx)) {
+        case RecordDescriptor::kFixnum:
+            if (!e->IsFixnum()) throw std::runtime_error("Fixnum expected");
+            fields()[idx] = e;
+            break;
+        case RecordDescriptor::kDouble:
+            if (e->IsFixnum())
+                doubles()[idx] = e->As<Fixnum>()->value();
+            else if (e->IsObject() && From(e)->IsFloat())
+                doubles()[idx] = Float::ConvertTo(e)->value();
+            else
+                throw std::runtime_error("number expected");
+            break;
+        default:
+            SetArrayField<kFields>(idx, e);
+            break;
+    }
+}
+
+} // namespace object
+} // namespace nrk
@@ -0,0 +1,128 @@
+#include <nerangake/object/rope.h>
+
+#include <assert.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <nerangake/context.h>
+#include <nerangake/object/string_slice.h>
+
+namespace nrk {
+namespace object {
+
+static uint32_t HashCode(const HeapObject *obj) {
+    assert(obj && "nullptr exception");
+
+    return String::HashCode(obj);
+}
+
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, &HashCode};
+    return &table;
+}
+
+/**
+ * Append bytes of `obj` into `out`, walks ropes with an explicit stack since
+ * ropes built by a loop are as deep as the number of pieces.
+ */
+static void AppendTo(std::string &out, const RawObject *obj) {
+    std::vector<const RawObject *> pending = {obj};
+    while (!pending.empty()) {
+        const RawObject *top = pending.back();
+        pending.pop_back();
+
+        if (top->IsShortString()) {
+            char buf[ShortString::kMaxLength];
+            uint32_t length = top->As<ShortString>()->Read(buf);
+            out.append(buf, length);
+            continue;
+        }
+
+        const HeapObject *heap = HeapObject::From(top);
+        if (heap->IsRope()) {
+            const Rope *rope = HeapObject::Cast<Rope>(heap);
+            if (!rope->flattened()) pending.push_back(rope->right());
+            pending.push_back(rope->left());
+        } else if (heap->IsStringSlice()) {
+            const StringSlice *slice = HeapObject::Cast<StringSlice>(heap);
+            out.append(slice->buffer(), slice->length());
+        } else {
+            const String *str = HeapObject::Cast<String>(heap);
+            out.append(str->buffer(), str->length());
+        }
+    }
+}
+
+RawObject *Rope::Concat(RawObject *lhs, RawObject *rhs) {
+    assert(lhs && rhs && "nullptr exception");
+
+    if (!String::IsString(lhs) || !String::IsString(rhs))
+        throw std::runtime_error("attempt to concatenate a non-string value");
+
+    uint32_t lhs_length = String::LengthOf(lhs);
+    uint32_t rhs_length = String::LengthOf(rhs);
+    if (rhs_length == 0) return lhs;
+    if (lhs_length == 0) return rhs;
+
+    // Checked here rather than when flattening, a rope longer than any
+    // `String` could never be flattened, hashed or sliced.
+    size_t length = (size_t)lhs_length + rhs_length;
+    if (length > String::kMaxLength)
+        throw std::runtime_error("string too large");
+    if (length > kFlatLimit) return Create(lhs, rhs, length);
+
+    std::string buf;
+    buf.reserve(length);
+    AppendTo(buf, lhs);
+    AppendTo(buf, rhs);
+    return String::New(buf.data(), buf.size());
+}
+
+Rope *Rope::Create(RawObject *lhs, RawObject *rhs, uint32_t length) {
+    HeapObject *left = lhs->IsObject() ? From(lhs) : nullptr;
+    HeapObject *right = rhs->IsObject() ? From(rhs) : nullptr;
+
+    GCInterface *gc = Context::gc();
+    if (left) gc->Push(&left);
+    if (right) gc->Push(&right);
+    Rope *rope = Allocate<Rope>(Size());
+    if (right) gc->Pop();
+    if (left) gc->Pop();
+
+    rope->set_type(kRope);
+    rope->set_vtable(VTable());
+    rope->set_length(length);
+    rope->set_left(left ? left : lhs);
+    rope->set_right(right ? right : rhs);
+    return rope;
+}
+
+RawObject *Rope::Flatten(RawObject *obj) {
+    assert(obj && "nullptr exception");
+
+    if (!obj->IsObject() || !From(obj)->IsRope()) return obj;
+
+    HeapObject *heap = From(obj);
+    Rope *rope = Cast<Rope>(heap);
+    if (rope->flattened()) return rope->left();
+
+    // Copy out before allocating, the rope may be moved by GC.
+    std::string buf;
+    buf.reserve(rope->length());
+    AppendTo(buf, rope);
+
+    GCInterface *gc = Context::gc();
+    gc->Push(&heap);
+    String *flat = String::Create(buf.data(), buf.size());
+    gc->Pop();
+
+    rope = Cast<Rope>(heap);
+    rope->set_left(flat);
+    rope->set_right(Nil::Create());
+    return flat;
+}
+
+} // namespace object
+} // namespace nrk
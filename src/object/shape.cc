@@ -0,0 +1,137 @@
+#include <nerangake/object/shape.h>
+
+#include <assert.h>
+
+#include <nerangake/context.h>
+#include <nerangake/object/array.h>
+
+namespace nrk {
+namespace object {
+
+// Shapes are never collected, number of shapes created so far.
+static uint32_t num_shapes = 0;
+
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
+/**
+ * Keeps the root of transition tree alive, the whole tree is reachable
+ * from it.
+ */
+class ShapeRootHolder : public memory::RootObjectHolderInterface {
+public:
+    explicit ShapeRootHolder(Shape *root) : root_(root) {
+        Context::RegisterRootObjectHolder(this);
+    }
+
+    ~ShapeRootHolder() { Context::CancelledRootObjectHolder(this); }
+
+    Shape *root() { return root_; }
+
+    virtual void ProcessRootObject(const Callback &cb) override {
+        root_ = ForwardingObject<Shape>(cb, root_);
+    }
+
+private:
+    Shape *root_;
+};
+
+Shape *Shape::Root() {
+    static ShapeRootHolder holder(Create(0, Nil::Create(), Nil::Create()));
+    return holder.root();
+}
+
+Shape *Shape::Create(uint32_t count, const RawObject *key, Element parent) {
+    // Shapes live as long as the virtual machine, allocates them in old
+    // space directly, which may compact it and move the parent.
+    HeapObject *held = parent->IsObject() ? HeapObject::From(parent) : nullptr;
+    GCInterface *gc = Context::gc();
+    if (held) gc->Push(&held);
+    Shape *shape = Static<Shape>(Size());
+    if (held) {
+        gc->Pop();
+        parent = held;
+    }
+
+    shape->set_type(kShape);
+    shape->set_vtable(VTable());
+    shape->set_count(count);
+    shape->set_child_count(0);
+    shape->set_key(key);
+    shape->set_parent(parent);
+    shape->set_children(Nil::Create());
+    ++num_shapes;
+    return shape;
+}
+
+/**
+ * The first slot of `key` in the children table, keys are ShortStrings, so
+ * their tagged words are mixed.
+ */
+static uint32_t ChildSlot(const RawObject *key) {
+    uint64_t bits = reinterpret_cast<uintptr_t>(key);
+    return static_cast<uint32_t>((bits * 0x9E3779B97F4A7C15ull) >> 32) &
+        (Shape::kChildSlots - 1);
+}
+
+Shape *Shape::FindChild(const RawObject *key) {
+    if (children()->IsNil()) return nullptr;
+
+    Array *table = Cast<Array>(HeapObject::From(children()));
+    for (uint32_t i = ChildSlot(key);; i = (i + 1) & (kChildSlots - 1)) {
+        Element link = table->Get(i);
+        // The table is never full, a probe ends at an empty slot.
+        if (link->IsNil()) return nullptr;
+
+        Shape *child = Cast<Shape>(HeapObject::From(link));
+        if (child->key() == key) return child;
+    }
+}
+
+bool Shape::CanTransition(const RawObject *key) {
+    if (FindChild(key)) return true;
+    return child_count() < kMaxChildren && num_shapes < kMaxShapes;
+}
+
+int32_t Shape::Lookup(const RawObject *key) const {
+    const Shape *shape = this;
+    while (!shape->IsRoot()) {
+        if (shape->key() == key) return shape->count() - 1;
+        shape = shape->GetFieldAs<const Shape *, kParent>();
+    }
+    return kNotFound;
+}
+
+Shape *Shape::Transition(const RawObject *key) {
+    assert(IsValidKey(key) && "shape key must be ShortString");
+    assert(Lookup(key) == kNotFound && "key already exists");
+
+    assert(CanTransition(key) && "too many transitions");
+
+    Shape *found = FindChild(key);
+    if (found) return found;
+
+    // Both the table and the child allocate, which may move this shape.
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    if (children()->IsNil()) {
+        Array *table = Array::Create(kChildSlots);
+        Cast<Shape>(self)->set_children(table);
+    }
+    Shape *child = Create(Cast<Shape>(self)->count() + 1, key, self);
+    gc->Pop();
+
+    Shape *parent = Cast<Shape>(self);
+    Array *table = Cast<Array>(HeapObject::From(parent->children()));
+    uint32_t i = ChildSlot(key);
+    while (!table->Get(i)->IsNil()) i = (i + 1) & (kChildSlots - 1);
+    table->Set(i, child);
+    parent->set_child_count(parent->child_count() + 1);
+    return child;
+}
+
+} // namespace object
+} // namespace nrk
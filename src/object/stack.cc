@@ -7,15 +7,8 @@
 namespace nrk {
 namespace object {
 
-static void Children(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception");
-
-    Stack *stack = HeapObject::Cast<Stack>(obj);
-    stack->Children(cb);
-}
-
 static const ObjectMethodTable *VTable() {
-    static ObjectMethodTable table = {nullptr, nullptr, &Children};
+    static ObjectMethodTable table = {nullptr, nullptr};
     return &table;
 }
 
@@ -181,7 +174,7 @@ const Array *Stack::current_buffer() const {
 }
 
 void Stack::set_current_buffer(Array *array) {
-    SetField<kArray, Array *>(array);
+    SetField<kArray>(array);
 }
 
 uint32_t Stack::depth() const { return GetFieldAs<uint32_t, kDepth>(); }
@@ -192,16 +185,5 @@ uint32_t Stack::offset() const { return GetFieldAs<uint32_t, kOffset>(); }
 
 void Stack::set_offset(uint32_t offset) { SetField<kOffset>(offset); }
 
-void Stack::Children(const ForwardingCallback &cb) {
-    Array *buffer = current_buffer();
-    buffer = ForwardingObject<Array>(cb, buffer);
-    set_current_buffer(buffer);
-
-    RawObject *t = top();
-    if (t->IsObject())
-        t = ForwardingObject<HeapObject>(cb, HeapObject::From(t));
-    set_top(t);
-}
-
 } // namespace object
 } // namespace nrk
@@ -2,28 +2,104 @@
 
 #include <string.h>
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
+
+#include <nerangake/context.h>
+#include <nerangake/object/rope.h>
+#include <nerangake/object/string_slice.h>
 
 namespace nrk {
 namespace object {
 
-static bool Equals(const HeapObject *obj1, const HeapObject *obj2) {
-    assert(obj1 && obj2 && "nullptr exception.");
-    assert(obj1->IsString() && obj2->IsString() && "type error");
+/**
+ * Exposes the bytes of `String`, `ShortString` or `StringSlice`, the bytes of
+ * `ShortString` are copied into `scratch` which must hold
+ * `ShortString::kMaxLength` bytes. `Rope` is read by `PieceReader`.
+ */
+static const char *BytesOf(
+    const RawObject *obj, char *scratch, uint32_t *length) {
+    if (obj->IsShortString()) {
+        *length = obj->As<ShortString>()->Read(scratch);
+        return scratch;
+    }
 
-    const String *str1 = HeapObject::Cast<String>(obj1);
-    const String *str2 = HeapObject::Cast<String>(obj2);
-    const char *buf1 = str1->buffer(), *buf2 = str2->buffer();
-    return str1->length() == str2->length() || strcmp(buf1, buf2) == 0;
+    const HeapObject *heap = HeapObject::From(obj);
+    if (heap->IsStringSlice()) {
+        const StringSlice *slice = HeapObject::Cast<StringSlice>(heap);
+        *length = slice->length();
+        return slice->buffer();
+    }
+
+    const String *str = HeapObject::Cast<String>(heap);
+    *length = str->length();
+    return str->buffer();
 }
 
-static uint32_t HashCode(const HeapObject *obj) {
-    assert(obj && "nullptr exception");
+static bool IsRopeObject(const RawObject *obj) {
+    return obj->IsObject() && HeapObject::From(obj)->IsRope();
+}
+
+/**
+ * PieceReader - reads the bytes of a string piece by piece in order, ropes are
+ * walked instead of flattened, so hashing and comparing strings never
+ * allocates on the object heap. Pending pieces are kept on an inline stack,
+ * only ropes nested deeper than `kInlineDepth` spill to the C++ heap.
+ */
+class PieceReader {
+public:
+    explicit PieceReader(const RawObject *obj) { Push(obj); }
+
+    // Returns false once every piece is read.
+    bool Next(const char **buf, uint32_t *length) {
+        while (size_ > 0) {
+            const RawObject *top = Pop();
 
-    const String *str = HeapObject::Cast<String>(obj);
-    size_t length = str->length();
-    const char *buf = str->buffer();
-    uint32_t hash = 0, x = 0;
+            if (IsRopeObject(top)) {
+                const Rope *rope =
+                    HeapObject::Cast<Rope>(HeapObject::From(top));
+                if (!rope->flattened()) Push(rope->right());
+                Push(rope->left());
+                continue;
+            }
+
+            *buf = BytesOf(top, scratch_, length);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    enum { kInlineDepth = 32 };
+
+    void Push(const RawObject *obj) {
+        if (size_ < kInlineDepth) {
+            inline_[size_] = obj;
+        } else {
+            spilled_.push_back(obj);
+        }
+        ++size_;
+    }
+
+    const RawObject *Pop() {
+        --size_;
+        if (size_ < kInlineDepth) return inline_[size_];
+
+        const RawObject *obj = spilled_.back();
+        spilled_.pop_back();
+        return obj;
+    }
+
+    const RawObject *inline_[kInlineDepth];
+    std::vector<const RawObject *> spilled_;
+    size_t size_ = 0;
+    char scratch_[ShortString::kMaxLength];
+};
+
+// Continues `hash` of the bytes before `buf`.
+static uint32_t HashBytes(uint32_t hash, const char *buf, size_t length) {
+    uint32_t x = 0;
     for (size_t i = 0; i < length; ++i) {
         hash = (hash << 4) + (uint32_t)buf[i];
 
@@ -33,7 +109,20 @@ static uint32_t HashCode(const HeapObject *obj) {
         }
     }
 
-    return hash & 0x7FFFFFFF;
+    return hash;
+}
+
+static bool Equals(const HeapObject *obj1, const HeapObject *obj2) {
+    assert(obj1 && obj2 && "nullptr exception.");
+    assert(obj1->IsString() && obj2->IsString() && "type error");
+
+    return String::Equals(obj1, obj2);
+}
+
+static uint32_t HashCode(const HeapObject *obj) {
+    assert(obj && "nullptr exception");
+
+    return String::HashCode(obj);
 }
 
 static ObjectMethodTable *VTable() {
@@ -43,6 +132,7 @@ static ObjectMethodTable *VTable() {
 
 String *String::Create(const char *str, size_t length) {
     assert(str != nullptr && "nullptr exception.");
+    if (length > kMaxLength) throw std::runtime_error("string too large");
 
     size_t need_size = Size(length);
     String *string = Allocate<String>(need_size);
@@ -52,6 +142,7 @@ String *String::Create(const char *str, size_t length) {
 
 String *String::CreateGlobal(const char *str, size_t length) {
     assert(str != nullptr && "nullptr exception.");
+    if (length > kMaxLength) throw std::runtime_error("string too large");
 
     size_t need_size = Size(length);
     HeapObject *obj = Static<HeapObject>(need_size);
@@ -60,6 +151,111 @@ String *String::CreateGlobal(const char *str, size_t length) {
     return string;
 }
 
+RawObject *String::New(const char *str, size_t length) {
+    assert(str != nullptr && "nullptr exception.");
+
+    if (ShortString::Fits(length)) return ShortString::Create(str, length);
+    return Create(str, length);
+}
+
+bool String::IsString(const RawObject *obj) {
+    if (obj->IsShortString()) return true;
+    if (!obj->IsObject()) return false;
+
+    const HeapObject *heap = HeapObject::From(obj);
+    return heap->IsString() || heap->IsRope() || heap->IsStringSlice();
+}
+
+uint32_t String::LengthOf(const RawObject *obj) {
+    assert(IsString(obj) && "type error");
+
+    if (obj->IsShortString()) return obj->As<ShortString>()->length();
+
+    const HeapObject *heap = HeapObject::From(obj);
+    if (heap->IsRope()) return Cast<Rope>(heap)->length();
+    if (heap->IsStringSlice()) return Cast<StringSlice>(heap)->length();
+    return Cast<String>(heap)->length();
+}
+
+char String::CharAt(const RawObject *obj, unsigned idx) {
+    assert(IsString(obj) && "type error");
+
+    // Descend to the piece holding `idx`.
+    while (obj->IsObject() && HeapObject::From(obj)->IsRope()) {
+        const Rope *rope = Cast<Rope>(HeapObject::From(obj));
+        if (idx >= rope->length())
+            throw std::runtime_error("out of string range");
+        if (rope->flattened()) {
+            obj = rope->left();
+            break;
+        }
+
+        uint32_t left_length = LengthOf(rope->left());
+        if (idx < left_length) {
+            obj = rope->left();
+        } else {
+            obj = rope->right();
+            idx -= left_length;
+        }
+    }
+
+    char scratch[ShortString::kMaxLength];
+    uint32_t length;
+    const char *buf = BytesOf(obj, scratch, &length);
+    if (idx >= length) throw std::runtime_error("out of string range");
+    return buf[idx];
+}
+
+uint32_t String::HashCode(const RawObject *obj) {
+    assert(IsString(obj) && "type error");
+
+    const char *buf;
+    uint32_t length;
+    if (!IsRopeObject(obj)) {
+        char scratch[ShortString::kMaxLength];
+        buf = BytesOf(obj, scratch, &length);
+        return HashBytes(0, buf, length) & 0x7FFFFFFF;
+    }
+
+    PieceReader reader(obj);
+    uint32_t hash = 0;
+    while (reader.Next(&buf, &length)) hash = HashBytes(hash, buf, length);
+    return hash & 0x7FFFFFFF;
+}
+
+bool String::Equals(const RawObject *lhs, const RawObject *rhs) {
+    if (!IsString(lhs) || !IsString(rhs)) return false;
+    if (LengthOf(lhs) != LengthOf(rhs)) return false;
+
+    if (!IsRopeObject(lhs) && !IsRopeObject(rhs)) {
+        char scratch1[ShortString::kMaxLength];
+        char scratch2[ShortString::kMaxLength];
+        uint32_t length;
+        const char *buf1 = BytesOf(lhs, scratch1, &length);
+        const char *buf2 = BytesOf(rhs, scratch2, &length);
+        return memcmp(buf1, buf2, length) == 0;
+    }
+
+    // Pieces of both sides split at different offsets, compare the overlap
+    // of the current ones.
+    PieceReader reader1(lhs), reader2(rhs);
+    const char *buf1 = nullptr, *buf2 = nullptr;
+    uint32_t len1 = 0, len2 = 0;
+    for (;;) {
+        if (len1 == 0 && !reader1.Next(&buf1, &len1)) break;
+        if (len2 == 0 && !reader2.Next(&buf2, &len2)) break;
+        if (len1 == 0 || len2 == 0) continue;
+
+        uint32_t n = std::min(len1, len2);
+        if (memcmp(buf1, buf2, n) != 0) return false;
+        buf1 += n;
+        buf2 += n;
+        len1 -= n;
+        len2 -= n;
+    }
+    return true;
+}
+
 void String::Init(String *string, const char *str, size_t length) {
     char *buf = string->buffer();
 
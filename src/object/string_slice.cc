@@ -0,0 +1,103 @@
+#include <nerangake/object/string_slice.h>
+
+#include <assert.h>
+#include <string.h> // memcpy
+
+#include <stdexcept>
+
+#include <nerangake/context.h>
+#include <nerangake/object/rope.h>
+
+namespace nrk {
+namespace object {
+
+static uint32_t HashCode(const HeapObject *obj) {
+    assert(obj && "nullptr exception");
+
+    return String::HashCode(obj);
+}
+
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, &HashCode};
+    return &table;
+}
+
+RawObject *StringSlice::Sub(RawObject *obj, uint32_t offset, uint32_t length) {
+    assert(obj && "nullptr exception");
+
+    if (!String::IsString(obj))
+        throw std::runtime_error("attempt to slice a non-string value");
+
+    uint32_t total = String::LengthOf(obj);
+    if (offset > total || length > total - offset)
+        throw std::runtime_error("out of string range");
+    if (offset == 0 && length == total) return obj;
+
+    obj = Rope::Flatten(obj);
+    if (obj->IsShortString()) {
+        char buf[ShortString::kMaxLength];
+        obj->As<ShortString>()->Read(buf);
+        return ShortString::Create(buf + offset, length);
+    }
+
+    // Slices always refer to a flat `String`, never to another slice.
+    const String *parent;
+    HeapObject *heap = From(obj);
+    if (heap->IsStringSlice()) {
+        const StringSlice *slice = Cast<StringSlice>(heap);
+        parent = slice->parent();
+        offset += slice->offset();
+    } else {
+        parent = Cast<String>(heap);
+    }
+
+    if (length <= kMinLength) {
+        char buf[kMinLength];
+        memcpy(buf, parent->buffer() + offset, length);
+        return String::New(buf, length);
+    }
+
+    return Create(parent, offset, length);
+}
+
+StringSlice *StringSlice::Create(
+    const String *parent, uint32_t offset, uint32_t length) {
+    HeapObject *obj = const_cast<String *>(parent);
+
+    GCInterface *gc = Context::gc();
+    gc->Push(&obj);
+    StringSlice *slice = Allocate<StringSlice>(Size());
+    gc->Pop();
+
+    slice->set_type(kStringSlice);
+    slice->set_vtable(VTable());
+    slice->set_offset(offset);
+    slice->set_length(length);
+    slice->set_parent(Cast<String>(obj));
+    return slice;
+}
+
+char StringSlice::At(unsigned idx) const {
+    if (idx >= length()) throw std::runtime_error("out of string range");
+
+    return buffer()[idx];
+}
+
+bool StringSlice::ShouldCopyOut() const {
+    uint32_t parent_length = parent()->length();
+    return parent_length >= kCopyOutParentLength &&
+        parent_length / kCopyOutRatio >= length();
+}
+
+size_t StringSlice::CopyOutSize() const {
+    return header_size() + String::Size(length());
+}
+
+void StringSlice::CopyOut(HeapObject *target) const {
+    assert(target && "nullptr exception");
+
+    String::Init(Cast<String>(target), buffer(), length());
+}
+
+} // namespace object
+} // namespace nrk
@@ -0,0 +1,111 @@
+#include <nerangake/object/switch_table.h>
+
+#include <assert.h>
+
+#include <stdexcept>
+
+#include <nerangake/object/string.h>
+
+namespace nrk {
+namespace object {
+
+static const uint32_t HASH_MULTIPLIER = 0x9E3779B1u;
+
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
+/**
+ * Case keys are immediates, a heap string short enough to be a case is
+ * looked up as its `ShortString` form.
+ */
+static const RawObject *Normalize(const RawObject *key) {
+    if (key->IsShortString() || !String::IsString(key)) return key;
+
+    uint32_t length = String::LengthOf(key);
+    if (!ShortString::Fits(length)) return key;
+
+    char buf[ShortString::kMaxLength];
+    for (uint32_t i = 0; i < length; ++i) buf[i] = String::CharAt(key, i);
+    return ShortString::Create(buf, length);
+}
+
+size_t SwitchTable::Size(Kind kind, uint32_t size) {
+    size_t entry = sizeof(int32_t);
+    if (kind == kHashed) entry += sizeof(RawObject *);
+    return sizeof(uint32_t) * 2 + sizeof(int32_t) * 2 + entry * size;
+}
+
+SwitchTable *SwitchTable::Create(
+    Kind kind, uint32_t size, int32_t low, int32_t default_target) {
+    // Tables are constants of prototypes, so they live as long as them.
+    SwitchTable *table = Static<SwitchTable>(Size(kind, size));
+    table->set_type(kSwitchTable);
+    table->set_vtable(VTable());
+    table->SetField<kKind>(static_cast<uint32_t>(kind));
+    table->SetField<kSize>(size);
+    table->SetField<kLow>(low);
+    table->SetField<kDefault>(default_target);
+    return table;
+}
+
+SwitchTable *SwitchTable::CreateDense(
+    int32_t low, const std::vector<int32_t> &targets,
+    int32_t default_target) {
+    uint32_t size = static_cast<uint32_t>(targets.size());
+    SwitchTable *table = Create(kDense, size, low, default_target);
+    for (uint32_t i = 0; i < size; ++i) table->targets()[i] = targets[i];
+    return table;
+}
+
+SwitchTable *SwitchTable::CreateHashed(
+    const std::vector<Case> &cases, int32_t default_target) {
+    // Keep the load under a half, so that probes are short.
+    uint32_t size = 4;
+    while (size < cases.size() * 2) size *= 2;
+
+    SwitchTable *table = Create(kHashed, size, 0, default_target);
+    for (uint32_t i = 0; i < size; ++i) table->keys()[i] = Nil::Create();
+
+    for (const Case &c : cases) {
+        if (!IsValidKey(c.first))
+            throw std::runtime_error("switch key must be Fixnum or string");
+
+        uint32_t slot = table->Probe(c.first);
+        if (!table->keys()[slot]->IsNil())
+            throw std::runtime_error("duplicate switch key");
+        table->keys()[slot] = c.first;
+        table->targets()[slot] = c.second;
+    }
+    return table;
+}
+
+uint32_t SwitchTable::Probe(const RawObject *key) const {
+    uint32_t mask = size() - 1;
+    uint32_t slot = (HeapObject::HashCode(key) * HASH_MULTIPLIER) >> 16;
+    for (slot &= mask;; slot = (slot + 1) & mask) {
+        const RawObject *k = keys()[slot];
+        if (k == key || k->IsNil()) return slot;
+    }
+}
+
+int32_t SwitchTable::Target(const RawObject *key) const {
+    if (kind() == kDense) {
+        if (!key->IsFixnum()) return default_target();
+
+        int64_t idx =
+            static_cast<int64_t>(key->As<Fixnum>()->value()) - low();
+        if (idx < 0 || idx >= size()) return default_target();
+        return targets()[idx];
+    }
+
+    key = Normalize(key);
+    if (!IsValidKey(key)) return default_target();
+
+    uint32_t slot = Probe(key);
+    return keys()[slot]->IsNil() ? default_target() : targets()[slot];
+}
+
+} // namespace object
+} // namespace nrk
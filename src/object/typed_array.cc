@@ -0,0 +1,333 @@
+#include <nerangake/object/typed_array.h>
+
+#include <assert.h>
+#include <string.h> // memset
+
+#include <stdexcept>
+
+#include <nerangake/context.h>
+#include <nerangake/object/float.h>
+
+namespace nrk {
+namespace object {
+
+static const ObjectMethodTable *VTable() {
+    static ObjectMethodTable table = {nullptr, nullptr};
+    return &table;
+}
+
+static RawObject *FromInteger(int64_t value) {
+    if (Fixnum::Fits(value))
+        return Fixnum::Create(static_cast<int32_t>(value));
+    return Float::Create(static_cast<double>(value));
+}
+
+static TypedArray *AsTypedArray(RawObject *obj) {
+    if (obj->IsObject()) {
+        HeapObject *heap = HeapObject::From(obj);
+        if (heap->IsTypedArray()) return HeapObject::Cast<TypedArray>(heap);
+    }
+    return nullptr;
+}
+
+static TypedArray *ExpectTypedArray(RawObject *obj) {
+    TypedArray *array = AsTypedArray(obj);
+    if (!array) throw std::runtime_error("typed array expected");
+    return array;
+}
+
+/**
+ * `rhs` must be a typed array of the same type and length as `lhs`, or a
+ * number fits the element type of `lhs`.
+ */
+static void CheckOperand(const TypedArray *lhs, RawObject *rhs) {
+    const TypedArray *array = AsTypedArray(rhs);
+    if (array) {
+        if (array->element_type() != lhs->element_type() ||
+            array->length() != lhs->length())
+            throw std::runtime_error("typed arrays mismatch");
+        return;
+    }
+
+    if (rhs->IsFixnum()) return;
+    if (lhs->element_type() == TypedArray::kFloat64 && rhs->IsObject() &&
+        HeapObject::From(rhs)->IsFloat())
+        return;
+    throw std::runtime_error("element type mismatch");
+}
+
+template <typename T>
+static T ScalarOf(RawObject *obj) {
+    return obj->As<Fixnum>()->value();
+}
+
+template <>
+double ScalarOf<double>(RawObject *obj) {
+    if (obj->IsFixnum()) return obj->As<Fixnum>()->value();
+    return HeapObject::Cast<Float>(HeapObject::From(obj))->value();
+}
+
+/**
+ * @return  elements of `rhs`, or `scalar` holding `rhs` to broadcast.
+ */
+template <typename T>
+static const T *OperandOf(RawObject *rhs, T *scalar, bool *broadcast) {
+    TypedArray *array = AsTypedArray(rhs);
+    *broadcast = array == nullptr;
+    if (array) return array->data<T>();
+
+    *scalar = ScalarOf<T>(rhs);
+    return scalar;
+}
+
+// Doubles go to the kernels selected at runtime.
+static void BinaryKernel(
+    simd::BinaryOp op, double *dst, const double *a, const double *b,
+    size_t n, bool broadcast) {
+    simd::Float64().binary(op, dst, a, b, n, broadcast);
+}
+
+template <typename T>
+static void BinaryKernel(
+    simd::BinaryOp op, T *dst, const T *a, const T *b, size_t n,
+    bool broadcast) {
+    simd::Binary<T>(op, dst, a, b, n, broadcast);
+}
+
+static void FmaKernel(
+    double *dst, const double *a, const double *b, size_t n, bool broadcast) {
+    simd::Float64().fma(dst, a, b, n, broadcast);
+}
+
+template <typename T>
+static void FmaKernel(
+    T *dst, const T *a, const T *b, size_t n, bool broadcast) {
+    simd::Fma<T>(dst, a, b, n, broadcast);
+}
+
+static void CompareKernel(
+    simd::CompareOp op, int32_t *dst, const double *a, const double *b,
+    size_t n, bool broadcast) {
+    simd::Float64().compare(op, dst, a, b, n, broadcast);
+}
+
+template <typename T>
+static void CompareKernel(
+    simd::CompareOp op, int32_t *dst, const T *a, const T *b, size_t n,
+    bool broadcast) {
+    simd::Compare<T>(op, dst, a, b, n, broadcast);
+}
+
+static RawObject *ReduceKernel(simd::ReduceOp op, const double *a, size_t n) {
+    if (n == 0 && op != simd::ReduceOp::kSum) return Nil::Create();
+    return Float::Create(simd::Float64().reduce(op, a, n));
+}
+
+template <typename T>
+static RawObject *ReduceKernel(simd::ReduceOp op, const T *a, size_t n) {
+    if (n == 0 && op != simd::ReduceOp::kSum) return Nil::Create();
+    return FromInteger(simd::Reduce<T>(op, a, n));
+}
+
+static RawObject *DotKernel(const double *a, const double *b, size_t n) {
+    return Float::Create(simd::Float64().dot(a, b, n));
+}
+
+template <typename T>
+static RawObject *DotKernel(const T *a, const T *b, size_t n) {
+    return FromInteger(simd::Dot<T>(a, b, n));
+}
+
+template <typename T>
+static void ApplyBinary(
+    simd::BinaryOp op, TypedArray *dst, TypedArray *lhs, RawObject *rhs) {
+    T scalar;
+    bool broadcast;
+    const T *b = OperandOf<T>(rhs, &scalar, &broadcast);
+    BinaryKernel(
+        op, dst->data<T>(), lhs->data<T>(), b, lhs->length(), broadcast);
+}
+
+template <typename T>
+static void ApplyFma(TypedArray *acc, TypedArray *lhs, RawObject *rhs) {
+    T scalar;
+    bool broadcast;
+    const T *b = OperandOf<T>(rhs, &scalar, &broadcast);
+    FmaKernel(acc->data<T>(), lhs->data<T>(), b, lhs->length(), broadcast);
+}
+
+template <typename T>
+static void ApplyCompare(
+    simd::CompareOp op, TypedArray *dst, TypedArray *lhs, RawObject *rhs) {
+    T scalar;
+    bool broadcast;
+    const T *b = OperandOf<T>(rhs, &scalar, &broadcast);
+    CompareKernel(
+        op, dst->data<int32_t>(), lhs->data<T>(), b, lhs->length(),
+        broadcast);
+}
+
+TypedArray *TypedArray::Create(ElementType type, uint32_t length) {
+    size_t size = Size(type, length);
+    if (header_size() + size >= (1u << 24))
+        throw std::runtime_error("typed array too large");
+
+    TypedArray *array = Allocate<TypedArray>(size);
+    array->set_type(kTypedArray);
+    array->set_vtable(VTable());
+    array->set_element_type(type);
+    array->set_length(length);
+    memset(array->data<uint8_t>(), 0, ElementSize(type) * length);
+    return array;
+}
+
+HeapObject::Element TypedArray::Get(uint32_t idx) const {
+    if (idx >= length()) throw std::runtime_error("index out of range.");
+
+    switch (element_type()) {
+        case kFloat64:
+            return Float::Create(data<double>()[idx]);
+        case kInt32:
+            return FromInteger(data<int32_t>()[idx]);
+        default:
+            return FromInteger(data<int64_t>()[idx]);
+    }
+}
+
+void TypedArray::Set(uint32_t idx, const RawObject *value) {
+    if (idx >= length()) throw std::runtime_error("index out of range.");
+
+    RawObject *val = const_cast<RawObject *>(value);
+    CheckOperand(this, val);
+    if (AsTypedArray(val)) throw std::runtime_error("number expected");
+
+    switch (element_type()) {
+        case kFloat64:
+            data<double>()[idx] = ScalarOf<double>(val);
+            break;
+        case kInt32:
+            data<int32_t>()[idx] = ScalarOf<int32_t>(val);
+            break;
+        default:
+            data<int64_t>()[idx] = ScalarOf<int64_t>(val);
+            break;
+    }
+}
+
+TypedArray *TypedArray::Binary(
+    simd::BinaryOp op, RawObject *lhs, RawObject *rhs) {
+    TypedArray *array = ExpectTypedArray(lhs);
+    CheckOperand(array, rhs);
+    ElementType type = array->element_type();
+
+    HeapObject *left = array;
+    HeapObject *right = rhs->IsObject() ? From(rhs) : nullptr;
+    GCInterface *gc = Context::gc();
+    gc->Push(&left);
+    if (right) gc->Push(&right);
+    TypedArray *result = Create(type, array->length());
+    if (right) {
+        gc->Pop();
+        rhs = right;
+    }
+    gc->Pop();
+
+    array = Cast<TypedArray>(left);
+    switch (type) {
+        case kFloat64:
+            ApplyBinary<double>(op, result, array, rhs);
+            break;
+        case kInt32:
+            ApplyBinary<int32_t>(op, result, array, rhs);
+            break;
+        default:
+            ApplyBinary<int64_t>(op, result, array, rhs);
+            break;
+    }
+    return result;
+}
+
+void TypedArray::Fma(RawObject *acc, RawObject *lhs, RawObject *rhs) {
+    TypedArray *dst = ExpectTypedArray(acc);
+    TypedArray *array = ExpectTypedArray(lhs);
+    CheckOperand(dst, lhs);
+    CheckOperand(dst, rhs);
+
+    switch (dst->element_type()) {
+        case kFloat64:
+            ApplyFma<double>(dst, array, rhs);
+            break;
+        case kInt32:
+            ApplyFma<int32_t>(dst, array, rhs);
+            break;
+        default:
+            ApplyFma<int64_t>(dst, array, rhs);
+            break;
+    }
+}
+
+RawObject *TypedArray::Reduce(simd::ReduceOp op, RawObject *obj) {
+    const TypedArray *array = ExpectTypedArray(obj);
+    uint32_t length = array->length();
+
+    switch (array->element_type()) {
+        case kFloat64:
+            return ReduceKernel(op, array->data<double>(), length);
+        case kInt32:
+            return ReduceKernel(op, array->data<int32_t>(), length);
+        default:
+            return ReduceKernel(op, array->data<int64_t>(), length);
+    }
+}
+
+RawObject *TypedArray::Dot(RawObject *lhs, RawObject *rhs) {
+    const TypedArray *a = ExpectTypedArray(lhs);
+    const TypedArray *b = ExpectTypedArray(rhs);
+    CheckOperand(a, rhs);
+    uint32_t length = a->length();
+
+    switch (a->element_type()) {
+        case kFloat64:
+            return DotKernel(a->data<double>(), b->data<double>(), length);
+        case kInt32:
+            return DotKernel(a->data<int32_t>(), b->data<int32_t>(), length);
+        default:
+            return DotKernel(a->data<int64_t>(), b->data<int64_t>(), length);
+    }
+}
+
+TypedArray *TypedArray::Compare(
+    simd::CompareOp op, RawObject *lhs, RawObject *rhs) {
+    TypedArray *array = ExpectTypedArray(lhs);
+    CheckOperand(array, rhs);
+    ElementType type = array->element_type();
+
+    HeapObject *left = array;
+    HeapObject *right = rhs->IsObject() ? From(rhs) : nullptr;
+    GCInterface *gc = Context::gc();
+    gc->Push(&left);
+    if (right) gc->Push(&right);
+    TypedArray *mask = Create(kInt32, array->length());
+    if (right) {
+        gc->Pop();
+        rhs = right;
+    }
+    gc->Pop();
+
+    array = Cast<TypedArray>(left);
+    switch (type) {
+        case kFloat64:
+            ApplyCompare<double>(op, mask, array, rhs);
+            break;
+        case kInt32:
+            ApplyCompare<int32_t>(op, mask, array, rhs);
+            break;
+        default:
+            ApplyCompare<int64_t>(op, mask, array, rhs);
+            break;
+    }
+    return mask;
+}
+
+} // namespace object
+} // namespace nrk
@@ -1,48 +1,68 @@
 #include <nerangake/object/vector.h>
 
 #include <assert.h>
+#include <string.h> // memcpy
 
+#include <algorithm>
 #include <stdexcept>
 
 #include <nerangake/context.h>
+#include <nerangake/object/float.h>
 
 namespace nrk {
 namespace object {
 
-static void Children(HeapObject *obj, const ForwardingCallback &cb) {
-    assert(obj && "nullptr exception");
-
-    Vector *vector = HeapObject::Cast<Vector>(obj);
-    vector->Children(cb);
-}
-
 static const ObjectMethodTable *VTable() {
-    static ObjectMethodTable table = {nullptr, nullptr, &Children};
+    static ObjectMethodTable table = {nullptr, nullptr};
     return &table;
 }
 
 size_t Vector::Size() {
-    return sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uintptr_t);
+    return sizeof(uint32_t) * 2 + sizeof(uintptr_t) * 2;
 }
 
 Vector *Vector::Create(size_t size) {
     HeapObject *obj = Allocate<HeapObject>(Size());
 
+    // New vector is packed until something else than Fixnum is stored.
     GCInterface *gc = Context::gc();
     gc->Push(&obj);
-    Array *array = Array::Create(size);
+    PackedArray *array = PackedArray::Create(size);
     gc->Pop();
 
     Vector *vector = Cast<Vector>(obj);
     vector->set_type(kVector);
     vector->set_length(0);
     vector->set_capacity(size);
+    vector->set_kind(kPackedFixnum);
     vector->set_buffer(array);
     vector->set_vtable(VTable());
 
     return vector;
 }
 
+Vector::ElementKind Vector::KindOf(const RawObject *e) {
+    if (e->IsFixnum()) return kPackedFixnum;
+    if (e->IsObject() && HeapObject::From(e)->IsFloat()) return kPackedDouble;
+    return kGeneric;
+}
+
+Vector *Vector::Slice(Vector *src, uint32_t begin, uint32_t end) {
+    if (begin > end || end > src->length())
+        throw std::runtime_error("index out of range.");
+
+    HeapObject *held = src;
+    GCInterface *gc = Context::gc();
+    gc->Push(&held);
+    HeapObject *obj = Create(end - begin);
+    gc->Push(&obj);
+    Cast<Vector>(obj)->AppendRange(Cast<Vector>(held), begin, end);
+    gc->Pop();
+    gc->Pop();
+
+    return Cast<Vector>(obj);
+}
+
 uint32_t Vector::length() const { return GetFieldAs<uint32_t, kLength>(); }
 
 uint32_t Vector::capacity() const { return GetFieldAs<uint32_t, kCapacity>(); }
@@ -51,7 +71,7 @@ void Vector::set_length(uint32_t val) { SetField<kLength, uint32_t>(val); }
 
 void Vector::set_capacity(uint32_t cap) { SetField<kCapacity>(cap); }
 
-void Vector::set_buffer(Array *array) { SetField<kArray>(array); }
+void Vector::set_buffer(HeapObject *array) { SetField<kArray>(array); }
 
 const Array *Vector::buffer() const { return GetFieldAs<Array *, kArray>(); }
 
@@ -69,40 +89,276 @@ Vector::Element Vector::Get(unsigned idx) {
 
 const Vector::Element Vector::Get(unsigned idx) const {
     if (idx >= length()) { throw std::runtime_error("index out of range."); }
-    return buffer()->Get(idx);
+
+    switch (kind()) {
+        case kPackedFixnum:
+            return Fixnum::Create(static_cast<int32_t>(IntAt(idx)));
+        case kPackedDouble:
+            return Float::Create(DoubleAt(idx));
+        default:
+            return buffer()->Get(idx);
+    }
 }
 
 void Vector::Set(unsigned idx, Element e) {
     if (idx >= length()) { throw std::runtime_error("index out of range."); }
-    return buffer()->Set(idx, e);
+
+    HeapObject *self = this;
+    HeapObject *held = e->IsObject() ? HeapObject::From(e) : nullptr;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    if (held) gc->Push(&held);
+    Transition(KindOf(e));
+    if (held) {
+        gc->Pop();
+        e = held;
+    }
+    gc->Pop();
+
+    Cast<Vector>(self)->StoreAt(idx, e);
 }
 
 void Vector::Push(Element e) {
-    uint32_t len = length();
-    if (capacity() == len) { Extend(); }
+    HeapObject *self = this;
+    HeapObject *held = e->IsObject() ? HeapObject::From(e) : nullptr;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    if (held) gc->Push(&held);
+    Transition(KindOf(e));
+    uint32_t len = Cast<Vector>(self)->length();
+    if (Cast<Vector>(self)->capacity() == len) { Cast<Vector>(self)->Extend(); }
+    if (held) {
+        gc->Pop();
+        e = held;
+    }
+    gc->Pop();
 
-    buffer()->Set(len, e);
-    set_length(len + 1);
+    Vector *vector = Cast<Vector>(self);
+    vector->StoreAt(len, e);
+    vector->set_length(len + 1);
 }
 
 Vector::Element Vector::Pop() {
     uint32_t len = length() - 1;
-    set_length(len);
-    return buffer()->Get(len);
+
+    // Boxing a double allocates.
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    Element e = Get(len);
+    gc->Pop();
+
+    Cast<Vector>(self)->set_length(len);
+    return e;
+}
+
+void Vector::Reserve(uint32_t capacity) {
+    if (capacity > this->capacity()) Grow(capacity);
+}
+
+void Vector::Reserve(uint32_t capacity, ElementKind kind) {
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    Transition(kind);
+    gc->Pop();
+
+    Cast<Vector>(self)->Reserve(capacity);
+}
+
+void Vector::Append(Vector *src) { AppendRange(src, 0, src->length()); }
+
+void Vector::AppendRange(Vector *src, uint32_t begin, uint32_t end) {
+    if (begin > end || end > src->length())
+        throw std::runtime_error("index out of range.");
+
+    uint32_t count = end - begin;
+    HeapObject *self = this, *held = src;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    gc->Push(&held);
+    Transition(src->kind());
+    uint32_t len = Cast<Vector>(self)->length();
+    uint32_t capacity = Cast<Vector>(self)->capacity();
+    if (len + count > capacity)
+        Cast<Vector>(self)->Grow(std::max(len + count, capacity * 2));
+    Cast<Vector>(self)->CopyRange(len, Cast<Vector>(held), begin, count);
+    gc->Pop();
+    gc->Pop();
+
+    Cast<Vector>(self)->set_length(len + count);
+}
+
+void Vector::Fill(Element e, uint32_t begin, uint32_t end) {
+    if (begin > end || end > length())
+        throw std::runtime_error("index out of range.");
+
+    HeapObject *self = this;
+    HeapObject *held = e->IsObject() ? HeapObject::From(e) : nullptr;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    if (held) gc->Push(&held);
+    Transition(KindOf(e));
+    if (held) {
+        gc->Pop();
+        e = held;
+    }
+    gc->Pop();
+
+    Vector *vector = Cast<Vector>(self);
+    switch (vector->kind()) {
+        case kPackedFixnum: {
+            int64_t *ints = vector->packed()->ints();
+            std::fill(ints + begin, ints + end, e->As<Fixnum>()->value());
+            break;
+        }
+        case kPackedDouble: {
+            double value = e->IsFixnum() ? e->As<Fixnum>()->value()
+                                         : Float::ConvertTo(e)->value();
+            double *doubles = vector->packed()->doubles();
+            std::fill(doubles + begin, doubles + end, value);
+            break;
+        }
+        default:
+            vector->buffer()->Fill(begin, end, e);
+            break;
+    }
+}
+
+void Vector::CopyWithin(uint32_t target, uint32_t begin, uint32_t end) {
+    uint32_t len = length();
+    if (begin > end || end > len || target > len - (end - begin))
+        throw std::runtime_error("index out of range.");
+
+    CopyRange(target, this, begin, end - begin);
+}
+
+void Vector::CopyRange(
+    uint32_t at, Vector *src, uint32_t begin, uint32_t count) {
+    // The kind of this vector is never less than the one of `src`, and both
+    // are the same if `src` is this vector.
+    ElementKind from = src->kind();
+    switch (kind()) {
+        case kPackedFixnum:
+            memmove(
+                packed()->ints() + at, src->packed()->ints() + begin,
+                count * sizeof(int64_t));
+            return;
+        case kPackedDouble:
+            if (from == kPackedDouble) {
+                memmove(
+                    packed()->doubles() + at, src->packed()->doubles() + begin,
+                    count * sizeof(double));
+            } else {
+                const int64_t *ints = src->packed()->ints() + begin;
+                double *doubles = packed()->doubles() + at;
+                for (uint32_t i = 0; i < count; ++i)
+                    doubles[i] = static_cast<double>(ints[i]);
+            }
+            return;
+        default:
+            break;
+    }
+
+    if (from == kGeneric) {
+        buffer()->Move(at, src->buffer(), begin, count);
+        return;
+    }
+
+    // Box packed elements one by one, boxing doubles allocates.
+    HeapObject *self = this, *held = src;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    gc->Push(&held);
+    for (uint32_t i = 0; i < count; ++i) {
+        Element e = Cast<Vector>(held)->Get(begin + i);
+        Cast<Vector>(self)->buffer()->Set(at + i, e);
+    }
+    gc->Pop();
+    gc->Pop();
+}
+
+void Vector::StoreAt(unsigned idx, Element e) {
+    switch (kind()) {
+        case kPackedFixnum:
+            SetIntAt(idx, e->As<Fixnum>()->value());
+            break;
+        case kPackedDouble:
+            if (e->IsFixnum())
+                SetDoubleAt(idx, e->As<Fixnum>()->value());
+            else
+                SetDoubleAt(idx, Float::ConvertTo(e)->value());
+            break;
+        default:
+            buffer()->Set(idx, e);
+            break;
+    }
 }
 
-void Vector::Extend() {
-    Array *array = Array::Create(capacity() * 2);
-    Array *buf = buffer();
+void Vector::Transition(ElementKind kind) {
+    ElementKind from = this->kind();
+    if (kind <= from) return;
+
     uint32_t len = length();
-    for (uint32_t i = 0; i < len; ++i) { array->Set(i, buf->Get(i)); }
-    set_buffer(array);
+    if (kind == kPackedDouble) {
+        // Same width, convert in place.
+        PackedArray *array = packed();
+        for (uint32_t i = 0; i < len; ++i)
+            array->doubles()[i] = static_cast<double>(array->ints()[i]);
+        set_kind(kPackedDouble);
+        return;
+    }
+
+    // Box every element, boxing doubles allocates, so keep this vector and
+    // the new array.
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    HeapObject *obj = Array::Create(capacity());
+    gc->Push(&obj);
+    for (uint32_t i = 0; i < len; ++i) {
+        Vector *vector = Cast<Vector>(self);
+        Element e;
+        if (from == kPackedFixnum)
+            e = Fixnum::Create(static_cast<int32_t>(vector->IntAt(i)));
+        else
+            e = Float::Create(vector->DoubleAt(i));
+        Cast<Array>(obj)->Set(i, e);
+    }
+    gc->Pop();
+    gc->Pop();
+
+    Vector *vector = Cast<Vector>(self);
+    vector->set_buffer(obj);
+    vector->set_kind(kGeneric);
 }
 
-void Vector::Children(const ForwardingCallback &cb) {
-    Array *array = const_cast<Array *>(buffer());
-    array = ForwardingObject<Array>(cb, array);
-    set_buffer(array);
+void Vector::Extend() { Grow(std::max<uint32_t>(capacity() * 2, 4)); }
+
+void Vector::Grow(uint32_t capacity) {
+    uint32_t len = length();
+    bool generic = kind() == kGeneric;
+
+    HeapObject *self = this;
+    GCInterface *gc = Context::gc();
+    gc->Push(&self);
+    HeapObject *obj;
+    if (generic)
+        obj = Array::Create(capacity);
+    else
+        obj = PackedArray::Create(capacity);
+    gc->Pop();
+
+    Vector *vector = Cast<Vector>(self);
+    if (generic) {
+        Cast<Array>(obj)->Move(0, vector->buffer(), 0, len);
+    } else {
+        memcpy(
+            Cast<PackedArray>(obj)->ints(), vector->packed()->ints(),
+            len * sizeof(int64_t));
+    }
+    vector->set_buffer(obj);
+    vector->set_capacity(capacity);
 }
 
 } // namespace object
@@ -0,0 +1,413 @@
+#include <nerangake/simd/kernels.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NRK_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace nrk {
+namespace simd {
+
+/**
+ * Scalar
+ */
+template <typename T>
+static T Apply(BinaryOp op, T x, T y) {
+    typedef typename std::make_unsigned<T>::type U;
+
+    switch (op) {
+        case BinaryOp::kAdd:
+            return static_cast<T>(static_cast<U>(x) + static_cast<U>(y));
+        case BinaryOp::kSub:
+            return static_cast<T>(static_cast<U>(x) - static_cast<U>(y));
+        case BinaryOp::kMul:
+            return static_cast<T>(static_cast<U>(x) * static_cast<U>(y));
+        default:
+            if (y == 0) throw std::runtime_error("divided by zero");
+            // the only overflowing division, wraps to itself.
+            if (y == -1) return static_cast<T>(U(0) - static_cast<U>(x));
+            return x / y;
+    }
+}
+
+static double Apply(BinaryOp op, double x, double y) {
+    switch (op) {
+        case BinaryOp::kAdd:
+            return x + y;
+        case BinaryOp::kSub:
+            return x - y;
+        case BinaryOp::kMul:
+            return x * y;
+        default:
+            return x / y;
+    }
+}
+
+template <typename T>
+static int32_t Apply(CompareOp op, T x, T y) {
+    switch (op) {
+        case CompareOp::kLT:
+            return x < y;
+        case CompareOp::kLE:
+            return x <= y;
+        default:
+            return x == y;
+    }
+}
+
+template <typename T>
+void Binary(
+    BinaryOp op, T *dst, const T *a, const T *b, size_t n, bool broadcast) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = Apply(op, a[i], broadcast ? b[0] : b[i]);
+}
+
+template <typename T>
+void Fma(T *dst, const T *a, const T *b, size_t n, bool broadcast) {
+    for (size_t i = 0; i < n; ++i) {
+        T product = Apply(BinaryOp::kMul, a[i], broadcast ? b[0] : b[i]);
+        dst[i] = Apply(BinaryOp::kAdd, dst[i], product);
+    }
+}
+
+template <typename T>
+int64_t Reduce(ReduceOp op, const T *a, size_t n) {
+    if (op == ReduceOp::kSum) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += static_cast<uint64_t>(a[i]);
+        return static_cast<int64_t>(sum);
+    }
+
+    if (n == 0) throw std::runtime_error("reduce empty array");
+    T result = a[0];
+    for (size_t i = 1; i < n; ++i) {
+        result = op == ReduceOp::kMin ? std::min(result, a[i])
+                                      : std::max(result, a[i]);
+    }
+    return result;
+}
+
+template <typename T>
+int64_t Dot(const T *a, const T *b, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += static_cast<uint64_t>(a[i]) * static_cast<uint64_t>(b[i]);
+    return static_cast<int64_t>(sum);
+}
+
+template <typename T>
+void Compare(
+    CompareOp op, int32_t *dst, const T *a, const T *b, size_t n,
+    bool broadcast) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = Apply(op, a[i], broadcast ? b[0] : b[i]);
+}
+
+template void Binary<int32_t>(
+    BinaryOp, int32_t *, const int32_t *, const int32_t *, size_t, bool);
+template void Binary<int64_t>(
+    BinaryOp, int64_t *, const int64_t *, const int64_t *, size_t, bool);
+template void Fma<int32_t>(
+    int32_t *, const int32_t *, const int32_t *, size_t, bool);
+template void Fma<int64_t>(
+    int64_t *, const int64_t *, const int64_t *, size_t, bool);
+template int64_t Reduce<int32_t>(ReduceOp, const int32_t *, size_t);
+template int64_t Reduce<int64_t>(ReduceOp, const int64_t *, size_t);
+template int64_t Dot<int32_t>(const int32_t *, const int32_t *, size_t);
+template int64_t Dot<int64_t>(const int64_t *, const int64_t *, size_t);
+template void Compare<int32_t>(
+    CompareOp, int32_t *, const int32_t *, const int32_t *, size_t, bool);
+template void Compare<int64_t>(
+    CompareOp, int32_t *, const int64_t *, const int64_t *, size_t, bool);
+
+static void ScalarBinary(
+    BinaryOp op, double *dst, const double *a, const double *b, size_t n,
+    bool broadcast) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = Apply(op, a[i], broadcast ? b[0] : b[i]);
+}
+
+static void ScalarFma(
+    double *dst, const double *a, const double *b, size_t n, bool broadcast) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = fma(a[i], broadcast ? b[0] : b[i], dst[i]);
+}
+
+static double ScalarReduce(ReduceOp op, const double *a, size_t n) {
+    if (op == ReduceOp::kSum) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += a[i];
+        return sum;
+    }
+
+    double result = std::numeric_limits<double>::quiet_NaN();
+    for (size_t i = 0; i < n; ++i) {
+        if (i == 0 || (op == ReduceOp::kMin ? a[i] < result : a[i] > result))
+            result = a[i];
+    }
+    return result;
+}
+
+static double ScalarDot(const double *a, const double *b, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+static void ScalarCompare(
+    CompareOp op, int32_t *dst, const double *a, const double *b, size_t n,
+    bool broadcast) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = Apply(op, a[i], broadcast ? b[0] : b[i]);
+}
+
+static const Float64Kernels kScalarKernels = {
+    "scalar",     &ScalarBinary, &ScalarFma,
+    &ScalarReduce, &ScalarDot,   &ScalarCompare,
+};
+
+#if defined(NRK_SIMD_X86) && defined(__SSE2__)
+/**
+ * SSE2, 2 doubles per vector. Tails are left to scalar kernels.
+ */
+static __m128d Sse2Apply(BinaryOp op, __m128d x, __m128d y) {
+    switch (op) {
+        case BinaryOp::kAdd:
+            return _mm_add_pd(x, y);
+        case BinaryOp::kSub:
+            return _mm_sub_pd(x, y);
+        case BinaryOp::kMul:
+            return _mm_mul_pd(x, y);
+        default:
+            return _mm_div_pd(x, y);
+    }
+}
+
+static __m128d Sse2Load(const double *b, size_t i, bool broadcast) {
+    return broadcast ? _mm_set1_pd(b[0]) : _mm_loadu_pd(b + i);
+}
+
+static void Sse2Binary(
+    BinaryOp op, double *dst, const double *a, const double *b, size_t n,
+    bool broadcast) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = Sse2Load(b, i, broadcast);
+        _mm_storeu_pd(dst + i, Sse2Apply(op, x, y));
+    }
+    ScalarBinary(op, dst + i, a + i, broadcast ? b : b + i, n - i, broadcast);
+}
+
+static double Sse2Sum(__m128d v) {
+    double lanes[2];
+    _mm_storeu_pd(lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+static double Sse2Reduce(ReduceOp op, const double *a, size_t n) {
+    if (n < 2) return ScalarReduce(op, a, n);
+
+    size_t i = 2;
+    __m128d acc = _mm_loadu_pd(a);
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        if (op == ReduceOp::kSum)
+            acc = _mm_add_pd(acc, x);
+        else if (op == ReduceOp::kMin)
+            acc = _mm_min_pd(acc, x);
+        else
+            acc = _mm_max_pd(acc, x);
+    }
+
+    // Fold lanes together with the tail, at most one element.
+    double lanes[2 + 1];
+    _mm_storeu_pd(lanes, acc);
+    size_t tail = n - i;
+    if (tail) lanes[2] = a[i];
+    return ScalarReduce(op, lanes, 2 + tail);
+}
+
+static double Sse2Dot(const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    __m128d acc = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_add_pd(
+            acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    return Sse2Sum(acc) + ScalarDot(a + i, b + i, n - i);
+}
+
+static void Sse2Compare(
+    CompareOp op, int32_t *dst, const double *a, const double *b, size_t n,
+    bool broadcast) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = Sse2Load(b, i, broadcast);
+        __m128d mask = op == CompareOp::kLT
+            ? _mm_cmplt_pd(x, y)
+            : op == CompareOp::kLE ? _mm_cmple_pd(x, y) : _mm_cmpeq_pd(x, y);
+        int bits = _mm_movemask_pd(mask);
+        dst[i] = bits & 1;
+        dst[i + 1] = (bits >> 1) & 1;
+    }
+    ScalarCompare(op, dst + i, a + i, broadcast ? b : b + i, n - i, broadcast);
+}
+
+static const Float64Kernels kSse2Kernels = {
+    // SSE2 has no fused multiply-add; an unfused mul+add would round twice
+    // and disagree with the scalar and AVX2 results, so use fma() per element.
+    "sse2",      &Sse2Binary, &ScalarFma,
+    &Sse2Reduce, &Sse2Dot,    &Sse2Compare,
+};
+#endif
+
+#if defined(NRK_SIMD_X86)
+/**
+ * AVX2 with FMA, 4 doubles per vector. Compiled for the target by function
+ * attributes, only called if CPU supports it.
+ */
+#define NRK_AVX2 __attribute__((target("avx2,fma")))
+
+NRK_AVX2 static __m256d Avx2Apply(BinaryOp op, __m256d x, __m256d y) {
+    switch (op) {
+        case BinaryOp::kAdd:
+            return _mm256_add_pd(x, y);
+        case BinaryOp::kSub:
+            return _mm256_sub_pd(x, y);
+        case BinaryOp::kMul:
+            return _mm256_mul_pd(x, y);
+        default:
+            return _mm256_div_pd(x, y);
+    }
+}
+
+NRK_AVX2 static __m256d Avx2Load(const double *b, size_t i, bool broadcast) {
+    return broadcast ? _mm256_set1_pd(b[0]) : _mm256_loadu_pd(b + i);
+}
+
+NRK_AVX2 static void Avx2Lanes(__m256d v, double *lanes) {
+    _mm256_storeu_pd(lanes, v);
+}
+
+NRK_AVX2 static void Avx2Binary(
+    BinaryOp op, double *dst, const double *a, const double *b, size_t n,
+    bool broadcast) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = Avx2Load(b, i, broadcast);
+        _mm256_storeu_pd(dst + i, Avx2Apply(op, x, y));
+    }
+    ScalarBinary(op, dst + i, a + i, broadcast ? b : b + i, n - i, broadcast);
+}
+
+NRK_AVX2 static void Avx2Fma(
+    double *dst, const double *a, const double *b, size_t n, bool broadcast) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = Avx2Load(b, i, broadcast);
+        __m256d acc = _mm256_loadu_pd(dst + i);
+        _mm256_storeu_pd(dst + i, _mm256_fmadd_pd(x, y, acc));
+    }
+    ScalarFma(dst + i, a + i, broadcast ? b : b + i, n - i, broadcast);
+}
+
+NRK_AVX2 static double Avx2Reduce(ReduceOp op, const double *a, size_t n) {
+    if (n < 4) return ScalarReduce(op, a, n);
+
+    size_t i = 4;
+    __m256d acc = _mm256_loadu_pd(a);
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        if (op == ReduceOp::kSum)
+            acc = _mm256_add_pd(acc, x);
+        else if (op == ReduceOp::kMin)
+            acc = _mm256_min_pd(acc, x);
+        else
+            acc = _mm256_max_pd(acc, x);
+    }
+
+    // Fold lanes together with the tail.
+    double lanes[4 + 3];
+    Avx2Lanes(acc, lanes);
+    size_t tail = n - i;
+    for (size_t j = 0; j < tail; ++j) lanes[4 + j] = a[i + j];
+    return ScalarReduce(op, lanes, 4 + tail);
+}
+
+NRK_AVX2 static double Avx2Dot(const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_fmadd_pd(
+            _mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc);
+
+    double lanes[4];
+    Avx2Lanes(acc, lanes);
+    double sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return sum + ScalarDot(a + i, b + i, n - i);
+}
+
+NRK_AVX2 static void Avx2Compare(
+    CompareOp op, int32_t *dst, const double *a, const double *b, size_t n,
+    bool broadcast) {
+    const int predicate = op == CompareOp::kLT
+        ? _CMP_LT_OQ
+        : op == CompareOp::kLE ? _CMP_LE_OQ : _CMP_EQ_OQ;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = Avx2Load(b, i, broadcast);
+        __m256d mask;
+        // the predicate of `_mm256_cmp_pd` must be a constant.
+        if (predicate == _CMP_LT_OQ)
+            mask = _mm256_cmp_pd(x, y, _CMP_LT_OQ);
+        else if (predicate == _CMP_LE_OQ)
+            mask = _mm256_cmp_pd(x, y, _CMP_LE_OQ);
+        else
+            mask = _mm256_cmp_pd(x, y, _CMP_EQ_OQ);
+
+        int bits = _mm256_movemask_pd(mask);
+        for (size_t j = 0; j < 4; ++j) dst[i + j] = (bits >> j) & 1;
+    }
+    ScalarCompare(op, dst + i, a + i, broadcast ? b : b + i, n - i, broadcast);
+}
+
+static const Float64Kernels kAvx2Kernels = {
+    "avx2",      &Avx2Binary, &Avx2Fma,
+    &Avx2Reduce, &Avx2Dot,    &Avx2Compare,
+};
+
+#undef NRK_AVX2
+#endif
+
+static const Float64Kernels *SelectFloat64() {
+#if defined(NRK_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return &kAvx2Kernels;
+#endif
+#if defined(NRK_SIMD_X86) && defined(__SSE2__)
+    return &kSse2Kernels;
+#else
+    return &kScalarKernels;
+#endif
+}
+
+const Float64Kernels &Float64() {
+    static const Float64Kernels *kernels = SelectFloat64();
+    return *kernels;
+}
+
+} // namespace simd
+} // namespace nrk
@@ -1,13 +1,77 @@
 #include <nerangake/vm_state.h>
 
+#include <algorithm>
+
 #include <nerangake/context.h>
 #include <nerangake/instruction.h>
 #include <nerangake/opcode.h>
 
 namespace nrk {
 
+/**
+ * @return  `obj` as HashMap if it is a shaped HashMap, otherwise nullptr.
+ */
+static object::HashMap *ShapedHashMap(object::RawObject *obj) {
+    using object::HashMap;
+    using object::HeapObject;
+
+    if (!obj->IsObject()) return nullptr;
+    HeapObject *heap = HeapObject::From(obj);
+    if (!heap->IsHashMap()) return nullptr;
+    HashMap *map = HeapObject::Cast<HashMap>(heap);
+    return map->IsShaped() ? map : nullptr;
+}
+
+/**
+ * @return  `obj` as Vector, throws if it isn't one.
+ */
+static object::Vector *ExpectVector(object::RawObject *obj) {
+    using object::HeapObject;
+    using object::Vector;
+
+    if (!obj->IsObject() || !HeapObject::From(obj)->IsVector())
+        throw std::runtime_error("vector expected");
+    return HeapObject::Cast<Vector>(HeapObject::From(obj));
+}
+
+/**
+ * Read the range `[reg(C), reg(C + 1))` of range instructions.
+ */
+static void RangeOf(
+    object::CallInfo *ci, uint8_t C, uint32_t *begin, uint32_t *end) {
+    using object::Fixnum;
+    using object::RawObject;
+
+    RawObject *first = ci->reg(C);
+    RawObject *last = ci->reg(C + 1);
+    if (!first->IsFixnum() || !last->IsFixnum())
+        throw std::runtime_error("slice bounds must be Fixnum");
+
+    int32_t b = first->As<Fixnum>()->value();
+    int32_t e = last->As<Fixnum>()->value();
+    if (b < 0 || e < b) throw std::runtime_error("error index");
+    *begin = static_cast<uint32_t>(b);
+    *end = static_cast<uint32_t>(e);
+}
+
+/**
+ * @return  `obj` as Record, throws if it isn't one.
+ */
+static object::Record *ExpectRecord(object::RawObject *obj) {
+    using object::HeapObject;
+    using object::Record;
+
+    if (!obj->IsObject() || !HeapObject::From(obj)->IsRecord())
+        throw std::runtime_error("record expected");
+    return HeapObject::Cast<Record>(HeapObject::From(obj));
+}
+
 VMState::VMState(const uint8_t *codes, size_t size)
-    : code_(codes), size_(size) {
+    : code_(codes),
+      size_(size),
+      inline_caches_(
+          Instruction::Distance(codes, codes + size),
+          InlineCache{nullptr, nullptr, 0}) {
     Context::RegisterRootObjectHolder(this);
     main_ = new VMScene();
     current_scene_ = main_;
@@ -49,6 +113,9 @@ bool VMState::Disptach(VMScene *scene, const uint8_t *pc) {
         case OPCode::kDec:
             ExecuteDec(scene);
             break;
+        case OPCode::kLen:
+            ExecuteLen(scene);
+            break;
         case OPCode::kAdd:
             ExecuteAdd(scene);
             break;
@@ -67,6 +134,69 @@ bool VMState::Disptach(VMScene *scene, const uint8_t *pc) {
         case OPCode::kPow:
             ExecutePow(scene);
             break;
+        case OPCode::kConcat:
+            ExecuteConcat(scene);
+            break;
+        case OPCode::kSlice:
+            ExecuteSlice(scene);
+            break;
+        case OPCode::kReserve:
+            ExecuteReserve(scene);
+            break;
+        case OPCode::kExtend:
+            ExecuteExtend(scene);
+            break;
+        case OPCode::kFill:
+            ExecuteFill(scene);
+            break;
+        case OPCode::kCopyWithin:
+            ExecuteCopyWithin(scene);
+            break;
+        case OPCode::kAppend:
+            ExecuteAppend(scene);
+            break;
+        case OPCode::kSetList:
+            ExecuteSetList(scene);
+            break;
+        case OPCode::kNewTyped:
+            ExecuteNewTyped(scene);
+            break;
+        case OPCode::kVAdd:
+            ExecuteVBinary(scene, simd::BinaryOp::kAdd);
+            break;
+        case OPCode::kVSub:
+            ExecuteVBinary(scene, simd::BinaryOp::kSub);
+            break;
+        case OPCode::kVMul:
+            ExecuteVBinary(scene, simd::BinaryOp::kMul);
+            break;
+        case OPCode::kVDiv:
+            ExecuteVBinary(scene, simd::BinaryOp::kDiv);
+            break;
+        case OPCode::kVFma:
+            ExecuteVFma(scene);
+            break;
+        case OPCode::kVSum:
+            ExecuteVReduce(scene, simd::ReduceOp::kSum);
+            break;
+        case OPCode::kVMin:
+            ExecuteVReduce(scene, simd::ReduceOp::kMin);
+            break;
+        case OPCode::kVMax:
+            ExecuteVReduce(scene, simd::ReduceOp::kMax);
+            break;
+        case OPCode::kVDot:
+            ExecuteVDot(scene);
+            break;
+        case OPCode::kVLT:
+            ExecuteVCompare(scene, simd::CompareOp::kLT);
+            break;
+        case OPCode::kVLE:
+            ExecuteVCompare(scene, simd::CompareOp::kLE);
+            break;
+        case OPCode::kVEQ:
+            ExecuteVCompare(scene, simd::CompareOp::kEQ);
+            break;
         case OPCode::kGT:
             ExecuteGT(scene);
             break;
@@ -124,6 +254,12 @@ bool VMState::Disptach(VMScene *scene, const uint8_t *pc) {
         case OPCode::kSetIndex:
             ExecuteSetIndex(scene);
             break;
+        case OPCode::kGetField:
+            ExecuteGetField(scene);
+            break;
+        case OPCode::kSetField:
+            ExecuteSetField(scene);
+            break;
         case OPCode::kIf:
             ExecuteIf(scene);
             break;
@@ -151,6 +287,15 @@ bool VMState::Disptach(VMScene *scene, const uint8_t *pc) {
         case OPCode::kBNZ:
             ExecuteBNZ(scene);
             break;
+        case OPCode::kSwitch:
+            ExecuteSwitch(scene);
+            break;
+        case OPCode::kIterPrep:
+            ExecuteIterPrep(scene);
+            break;
+        case OPCode::kIterNext:
+            ExecuteIterNext(scene);
+            break;
         case OPCode::kPush:
             ExecutePush(scene);
             break;
@@ -178,6 +323,9 @@ bool VMState::Disptach(VMScene *scene, const uint8_t *pc) {
         case OPCode::kNewArray:
             ExecuteNewArray(scene);
             break;
+        case OPCode::kNewRecord:
+            ExecuteNewRecord(scene);
+            break;
         case OPCode::kNewClosure:
             ExecuteNewClosure(scene);
             break;
@@ -258,6 +406,21 @@ void VMState::ExecuteDec(VMScene *scene) {
     ci->SetNextPC(1);
 }
 
+void VMState::ExecuteLen(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    RawObject *b = ci->reg(B);
+    RawObject *a = RawObject::Len(b);
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
 void VMState::ExecuteAdd(VMScene *scene) {
     assert(scene && "nullptr exception");
 
@@ -360,6 +523,278 @@ void VMState::ExecutePow(VMScene *scene) {
     ci->SetNextPC(1);
 }
 
+void VMState::ExecuteConcat(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    assert(B <= C && "invalid register range");
+
+    // Long results are linked by `Rope`, so a loop appending to the same
+    // string costs linear time in total. Concatenating allocates, which may
+    // move the CallInfo.
+    RawObject *a = ci->reg(B);
+    for (unsigned i = B + 1; i <= C; ++i) {
+        a = Rope::Concat(a, ci->reg(i));
+        ci = scene->top();
+    }
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteSlice(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    uint32_t first, last;
+    RangeOf(ci, C, &first, &last);
+
+    // Both slices allocate, which may move the CallInfo.
+    RawObject *b = ci->reg(B);
+    RawObject *a;
+    if (b->IsObject() && HeapObject::From(b)->IsVector())
+        a = Vector::Slice(ExpectVector(b), first, last);
+    else
+        a = StringSlice::Sub(b, first, last - first);
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteReserve(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    RawObject *b = ci->reg(B);
+    if (!b->IsFixnum() || b->As<Fixnum>()->value() < 0)
+        throw std::runtime_error("error capacity");
+
+    Vector *a = ExpectVector(ci->reg(A));
+    a->Reserve(static_cast<uint32_t>(b->As<Fixnum>()->value()));
+    ci = scene->top();
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteExtend(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    Vector *a = ExpectVector(ci->reg(A));
+    a->Append(ExpectVector(ci->reg(B)));
+    ci = scene->top();
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteFill(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    uint32_t begin, end;
+    RangeOf(ci, C, &begin, &end);
+
+    Vector *a = ExpectVector(ci->reg(A));
+    a->Fill(ci->reg(B), begin, end);
+    ci = scene->top();
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteCopyWithin(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *b = ci->reg(B);
+    if (!b->IsFixnum() || b->As<Fixnum>()->value() < 0)
+        throw std::runtime_error("error index");
+
+    uint32_t begin, end;
+    RangeOf(ci, C, &begin, &end);
+
+    Vector *a = ExpectVector(ci->reg(A));
+    a->CopyWithin(
+        static_cast<uint32_t>(b->As<Fixnum>()->value()), begin, end);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteAppend(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    Vector *a = ExpectVector(ci->reg(A));
+    a->Push(ci->reg(B));
+    ci = scene->top();
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteSetList(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    if (ci->reg(A)->IsNil()) {
+        RawObject *a = Vector::Create(B);
+        ci = scene->top();
+        ci->set_reg(A, a);
+    }
+
+    // Widen the kind and the capacity once up front, then no store below
+    // allocates, and the registers stay put.
+    Vector::ElementKind kind = Vector::kPackedFixnum;
+    for (unsigned i = 1; i <= B; ++i)
+        kind = std::max(kind, Vector::KindOf(ci->reg(A + i)));
+
+    Vector *a = ExpectVector(ci->reg(A));
+    a->Reserve(a->length() + B, kind);
+    ci = scene->top();
+
+    a = ExpectVector(ci->reg(A));
+    for (unsigned i = 1; i <= B; ++i) a->Push(ci->reg(A + i));
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteNewTyped(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    if (B > TypedArray::kInt64)
+        throw std::runtime_error("unknown element type");
+
+    RawObject *c = ci->reg(C);
+    if (!c->IsFixnum() || c->As<Fixnum>()->value() < 0)
+        throw std::runtime_error("error length");
+
+    auto type = static_cast<TypedArray::ElementType>(B);
+    uint32_t length = static_cast<uint32_t>(c->As<Fixnum>()->value());
+    RawObject *a = TypedArray::Create(type, length);
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteVBinary(VMScene *scene, simd::BinaryOp op) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *a = TypedArray::Binary(op, ci->reg(B), ci->reg(C));
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteVFma(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    TypedArray::Fma(ci->reg(A), ci->reg(B), ci->reg(C));
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteVReduce(VMScene *scene, simd::ReduceOp op) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    RawObject *a = TypedArray::Reduce(op, ci->reg(B));
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteVDot(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *a = TypedArray::Dot(ci->reg(B), ci->reg(C));
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteVCompare(VMScene *scene, simd::CompareOp op) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *a = TypedArray::Compare(op, ci->reg(B), ci->reg(C));
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
 void VMState::ExecuteGT(VMScene *scene) {
     assert(scene && "nullptr exception");
 
@@ -473,7 +908,7 @@ void VMState::ExecuteMoveS(VMScene *scene) {
 
     assert(strings_.size() < Bx && "index out of string poll size");
 
-    String *string = strings_[Bx];
+    RawObject *string = strings_[Bx];
     ci->set_reg(A, string);
     ci->SetNextPC(1);
 }
@@ -562,7 +997,18 @@ void VMState::ExecuteIndex(VMScene *scene) {
 
     RawObject *c = ci->reg(C);
     RawObject *b = ci->reg(B);
+
+    HashMap *map = ShapedHashMap(b);
+    InlineCache *ic = map ? FindInlineCache(pc) : nullptr;
+    if (ic && ic->shape == map->shape() && ic->key == c) {
+        ci->set_reg(A, map->slot_value(ic->slot));
+        ci->SetNextPC(1);
+        return;
+    }
+
+    // Looking up never allocates, `map` is still valid.
     RawObject *a = RawObject::Index(b, c);
+    if (ic) UpdateInlineCache(ic, map, c);
     ci->set_reg(A, a);
     ci->SetNextPC(1);
 }
@@ -658,8 +1104,52 @@ void VMState::ExecuteSetIndex(VMScene *scene) {
     RawObject *a = ci->reg(A);
     RawObject *b = ci->reg(B);
     RawObject *c = ci->reg(C);
+
+    HashMap *map = ShapedHashMap(a);
+    InlineCache *ic = map ? FindInlineCache(pc) : nullptr;
+    if (ic && !c->IsNil() && ic->shape == map->shape() && ic->key == b) {
+        map->set_slot_value(ic->slot, c);
+        ci->SetNextPC(1);
+        return;
+    }
+
     RawObject::SetIndex(a, b, c);
 
+    // Adding a key may allocate, reload the map. A cached key is never a
+    // heap object, so `b` is safe to compare.
+    ci = scene->top();
+    map = ShapedHashMap(ci->reg(A));
+    if (ic && map) UpdateInlineCache(ic, map, b);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteGetField(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *a = ExpectRecord(ci->reg(B))->Get(C);
+    ci = scene->top();
+    ci->set_reg(A, a);
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteSetField(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    ExpectRecord(ci->reg(A))->Set(B, ci->reg(C));
     ci->SetNextPC(1);
 }
 
@@ -806,6 +1296,61 @@ void VMState::ExecuteBNZ(VMScene *scene) {
     ci->SetNextPC(RawObject::NZ(a) ? B : 1);
 }
 
+void VMState::ExecuteSwitch(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint16_t Bx = Instruction::Bx(pc);
+
+    const Prototype *proto = ci->callee()->callee();
+    const SwitchTable *table = proto->switch_table(Bx);
+    ci->SetNextPC(table->Target(ci->reg(A)));
+}
+
+void VMState::ExecuteIterPrep(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t B = Instruction::B(pc);
+
+    ci->set_reg(A, ci->reg(B));
+    ci->set_reg(A + 1, Fixnum::Create(0));
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteIterNext(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *cursor = ci->reg(A + 1);
+    if (!cursor->IsFixnum() || cursor->As<Fixnum>()->value() < 0)
+        throw std::runtime_error("error cursor");
+
+    uint32_t position = static_cast<uint32_t>(cursor->As<Fixnum>()->value());
+    RawObject *key, *value;
+    if (!RawObject::Next(ci->reg(A), &position, &key, &value)) {
+        ci->SetNextPC(C);
+        return;
+    }
+
+    ci = scene->top();
+    ci->set_reg(A + 1, Fixnum::Create(static_cast<int32_t>(position)));
+    ci->set_reg(A + 2, key);
+    ci->set_reg(A + 3, value);
+    ci->SetNextPC(1);
+}
+
 void VMState::ExecutePush(VMScene *scene) {
     assert(scene && "nullptr exception");
 
@@ -939,7 +1484,12 @@ void VMState::ExecuteNewHash(VMScene *scene) {
     const uint8_t *pc = ci->saved_pc();
 
     uint8_t A = Instruction::A(pc);
-    ci->set_reg(A, HashMap::Create());
+    uint8_t B = Instruction::B(pc);
+    uint8_t C = Instruction::C(pc);
+
+    RawObject *a = HashMap::Create(B, C);
+    ci = scene->top();
+    ci->set_reg(A, a);
 
     ci->SetNextPC(1);
 }
@@ -951,8 +1501,30 @@ void VMState::ExecuteNewArray(VMScene *scene) {
     const uint8_t *pc = ci->saved_pc();
 
     uint8_t A = Instruction::A(pc);
-    ci->set_reg(A, Vector::Create());
+    uint8_t B = Instruction::B(pc);
+
+    RawObject *a = B == 0 ? Vector::Create() : Vector::Create(B);
+    ci = scene->top();
+    ci->set_reg(A, a);
+
+    ci->SetNextPC(1);
+}
+
+void VMState::ExecuteNewRecord(VMScene *scene) {
+    assert(scene && "nullptr exception");
+
+    CallInfo *ci = scene->top();
+    const uint8_t *pc = ci->saved_pc();
+
+    uint8_t A = Instruction::A(pc);
+    uint16_t Bx = Instruction::Bx(pc);
+
+    if (Bx >= record_descriptors_.size())
+        throw std::runtime_error("record descriptor not found");
 
+    RawObject *a = Record::Create(record_descriptors_[Bx]);
+    ci = scene->top();
+    ci->set_reg(A, a);
     ci->SetNextPC(1);
 }
 
@@ -1039,20 +1611,61 @@ void VMState::AddFloat(Float *f) {
 void VMState::AddString(String *string) {
     assert(string && "nullptr exception");
 
-    strings_.push_back(string);
+    // Constants short enough are kept as `ShortString`, so that loading them
+    // never touches heap.
+    const String *str = string;
+    uint32_t length = str->length();
+    if (ShortString::Fits(length)) {
+        strings_.push_back(ShortString::Create(str->buffer(), length));
+    } else {
+        strings_.push_back(string);
+    }
+}
+
+void VMState::AddRecordDescriptor(RecordDescriptor *descriptor) {
+    assert(descriptor && "nullptr exception");
+
+    record_descriptors_.push_back(descriptor);
 }
 
 bool VMState::IsUserClosureExists(const std::string &str) const {
     return user_closure_map_.count(str);
 }
 
+VMState::InlineCache *VMState::FindInlineCache(const uint8_t *pc) {
+    // Code outside of `code_` runs without inline caches.
+    if (pc < code_ || pc >= code_ + size_) return nullptr;
+    return &inline_caches_[Instruction::Distance(code_, pc)];
+}
+
+void VMState::UpdateInlineCache(
+    InlineCache *ic, HashMap *map, RawObject *key) {
+    // Hits compare keys by identity, a heap string key is never cached, even
+    // though its slot is found by content.
+    if (!Shape::IsValidKey(key)) return;
+
+    int32_t slot = map->SlotOf(key);
+    if (slot == Shape::kNotFound) return;
+
+    ic->shape = map->shape();
+    ic->key = key;
+    ic->slot = static_cast<uint32_t>(slot);
+}
+
 void VMState::ProcessRootObject(const Callback &cb) {
     for (auto &closure : closures_)
         closure = ForwardingObject<Closure>(cb, closure);
     for (auto &proto : prototypes_)
         proto = ForwardingObject<Prototype>(cb, proto);
     for (auto &f : floats_) f = ForwardingObject<Float>(cb, f);
-    for (auto &str : strings_) str = ForwardingObject<String>(cb, str);
+    for (auto &descriptor : record_descriptors_)
+        descriptor = ForwardingObject<RecordDescriptor>(cb, descriptor);
+    for (auto &str : strings_) {
+        if (str->IsObject()) {
+            HeapObject *obj = HeapObject::From(str);
+            str = ForwardingObject<String>(cb, obj);
+        }
+    }
     for (auto &global : globals_) {
         if (global->IsObject()) {
             HeapObject *obj = HeapObject::From(global);
@@ -1060,6 +1673,11 @@ void VMState::ProcessRootObject(const Callback &cb) {
         }
     }
     for (auto &fn : user_closures_) fn = ForwardingObject<UserClosure>(cb, fn);
+    for (auto &ic : inline_caches_) {
+        if (ic.shape == nullptr) continue;
+        HeapObject *obj = HeapObject::From(ic.shape);
+        ic.shape = ForwardingObject<HeapObject>(cb, obj);
+    }
 }
 
 }  // namespace vm